@@ -0,0 +1,174 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "bench.h"
+#include "realtime.h"
+#include "ledconfig.h"
+#include "led_color.h"
+#include "led_driver.h"
+#include "led_effects.h"
+#include "led_render.h"
+#include "led_sim.h"
+
+// Benchmarks of the linux target build
+// Every render case renders and presents full frames on the simulated strip
+
+// Minimum frame count of one render case
+#define BENCH_MIN_FRAMES 20
+
+// Effect time advanced per frame, as if running at the configured frame rate
+#define BENCH_FRAME_MS (1000 / CONFIG_LED_FPS)
+
+// Pixels per pass of the white extraction kernel benchmark
+#define BENCH_KERNEL_PIXELS 1000
+
+static const char *TAG = "bench";
+
+static const int bench_led_counts[] = { 30, 300, 3000 };
+#define BENCH_LED_COUNTS (sizeof(bench_led_counts) / sizeof(bench_led_counts[0]))
+
+// Render frames of one light state until the case has run long enough
+static void bench_case(const char *name, int led_count, const light_state_t *state,
+                       led_rgb_t *effect_pixels, uint8_t *effect_scratch)
+{
+    const led_pixel_layout_t *layout = led_driver_layout();
+    uint32_t frames = 0;
+    uint32_t now = 0;
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed;
+
+    do {
+        uint8_t *frame = led_driver_back_buffer();
+        led_render_pixels(frame, layout, 0, led_count, state, effect_pixels, effect_scratch,
+                          led_color_frame_dither((uint8_t)frames), now);
+        led_driver_present();
+        frames++;
+        now += BENCH_FRAME_MS;
+        elapsed = esp_timer_get_time() - start;
+    } while (elapsed < BENCH_MIN_US || frames < BENCH_MIN_FRAMES);
+
+    uint64_t fps = (uint64_t)frames * 1000000 / elapsed;
+    // Tenths of a nanosecond, a host build is fast enough to need the decimal
+    uint64_t ns_per_pixel_x10 = (uint64_t)elapsed * 10000 / ((uint64_t)frames * led_count);
+    printf("%-10s %-5s %6d %10" PRIu64 " %10" PRIu64 ".%" PRIu64 "\n", name,
+           led_driver_has_white(layout) ? "rgbw" : "rgb", led_count, fps,
+           ns_per_pixel_x10 / 10, ns_per_pixel_x10 % 10);
+}
+
+// Cost of the white extraction kernel on its own, against a plain copy of the levels
+static void bench_white_extraction(void)
+{
+    static uint16_t in[BENCH_KERNEL_PIXELS][3];
+    static uint16_t out[BENCH_KERNEL_PIXELS][4];
+    uint32_t seed = 1;
+    for (int i = 0; i < BENCH_KERNEL_PIXELS; i++) {
+        for (int c = 0; c < 3; c++) {
+            seed = seed * 1103515245 + 12345;
+            in[i][c] = gamma_lut[(seed >> 16) % GAMMA_LUT_SIZE];
+        }
+    }
+
+    uint64_t ns_per_1000[2];
+    for (int extract = 0; extract < 2; extract++) {
+        uint32_t passes = 0;
+        int64_t start = esp_timer_get_time();
+        int64_t elapsed;
+        do {
+            for (int i = 0; i < BENCH_KERNEL_PIXELS; i++) {
+                uint16_t r = in[i][0], g = in[i][1], b = in[i][2], w = 0;
+                if (extract) {
+                    led_color_extract_white(&r, &g, &b, &w);
+                }
+                out[i][0] = r;
+                out[i][1] = g;
+                out[i][2] = b;
+                out[i][3] = w;
+            }
+            // Keep the compiler from dropping or merging the passes
+            __asm__ volatile("" : : "r"(out) : "memory");
+            passes++;
+            elapsed = esp_timer_get_time() - start;
+        } while (elapsed < BENCH_MIN_US);
+        ns_per_1000[extract] = (uint64_t)elapsed * 1000 * 1000 / ((uint64_t)passes * BENCH_KERNEL_PIXELS);
+    }
+
+    printf("white extraction: %" PRIu64 " ns per 1000 pixels (%" PRIu64 " ns copy only, %" PRIu64 " ns copy + extraction)\n",
+           ns_per_1000[1] > ns_per_1000[0] ? ns_per_1000[1] - ns_per_1000[0] : 0, ns_per_1000[0], ns_per_1000[1]);
+}
+
+static void bench_led_count(led_chip_t chip, int led_count)
+{
+    led_hw_config_t config = {
+        .gpio = CONFIG_LED_GPIO,
+        .chip = chip,
+        .color_order = LED_ORDER_GRB,
+        .led_count = led_count,
+    };
+    if (!led_driver_init(&config)) {
+        ESP_LOGE(TAG, "Failed to initialise a strip of %d LEDs", led_count);
+        return;
+    }
+
+    led_rgb_t *effect_pixels = calloc(led_count, sizeof(led_rgb_t));
+    uint8_t *effect_scratch = calloc(led_count, sizeof(uint8_t));
+    if (effect_pixels == NULL || effect_scratch == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate effect buffers for %d LEDs", led_count);
+    } else {
+        // A color with fractional levels, so the dithering path is measured as well
+        light_state_t state = {
+            .is_on = true,
+            .r = 4095,
+            .g = 1700,
+            .b = 300,
+            .w = 600,
+            .brightness = 3000,
+            .effect = LED_EFFECT_SOLID,
+        };
+        bench_case("static", led_count, &state, effect_pixels, effect_scratch);
+
+        for (int i = 0; i < led_effects_count(); i++) {
+            if (i == LED_EFFECT_SOLID) {
+                continue;
+            }
+            state.effect = i;
+            bench_case(led_effects_get(i)->name, led_count, &state, effect_pixels, effect_scratch);
+        }
+    }
+
+    // Every frame went out through the simulated strip
+    led_sim_frame_t frame;
+    if (led_sim_get_frame(0, &frame)) {
+        ESP_LOGI(TAG, "%d LEDs: %" PRIu32 " frames presented, last at %lld us",
+                 led_count, led_sim_frame_count(), (long long)frame.timestamp_us);
+    }
+
+    free(effect_pixels);
+    free(effect_scratch);
+    led_driver_deinit();
+}
+
+void app_main(void)
+{
+#if CONFIG_LED_SIM_REALTIME
+    realtime_sim_run();
+    exit(1);
+#endif
+
+    printf("%-10s %-5s %6s %10s %12s\n", "case", "strip", "leds", "frames/s", "ns/pixel");
+    for (size_t i = 0; i < BENCH_LED_COUNTS; i++) {
+        bench_led_count(LED_CHIP_WS2812B, bench_led_counts[i]);
+    }
+    for (size_t i = 0; i < BENCH_LED_COUNTS; i++) {
+        bench_led_count(LED_CHIP_SK6812_RGBW, bench_led_counts[i]);
+    }
+
+    bench_white_extraction();
+
+    printf("\n");
+    bench_light_json();
+    fflush(stdout);
+    exit(0);
+}
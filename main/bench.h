@@ -0,0 +1,15 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include "esp_timer.h"
+
+// Benchmarks of the linux target build, run from app_main in bench.c
+
+// Minimum run time of one benchmark case
+#define BENCH_MIN_US 500000
+
+// MQTT payload handling: light_json against the cJSON code it replaced
+void bench_light_json(void);
+
+#endif // BENCH_H
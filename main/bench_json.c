@@ -0,0 +1,235 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include <cJSON.h>
+
+#include "bench.h"
+#include "led_effects.h"
+#include "light_json.h"
+#include "light_binary.h"
+
+static const char *TAG = "bench_json";
+
+// Commands as Home Assistant sends them, from a brightness slider drag to a full state
+static const char *const bench_commands[] = {
+    "{\"state\":\"ON\",\"brightness\":1834}",
+    "{\"state\":\"ON\",\"color\":{\"r\":4095,\"g\":1200,\"b\":0,\"w\":0}}",
+    "{\"state\":\"ON\",\"effect\":\"rainbow\",\"transition\":0.5}",
+    "{\"state\":\"ON\",\"brightness\":4095,\"color\":{\"r\":255,\"g\":128,\"b\":64,\"w\":512},\"transition\":2,\"effect\":\"solid\"}",
+    "{\"state\":\"OFF\"}",
+};
+#define BENCH_COMMAND_COUNT (sizeof(bench_commands) / sizeof(bench_commands[0]))
+
+// The same commands in the binary layout of light_binary.h
+#define LE16(v) (uint8_t)((v) & 0xFF), (uint8_t)(((v) >> 8) & 0xFF)
+#define LE32(v) LE16((v) & 0xFFFF), LE16(((v) >> 16) & 0xFFFF)
+static const uint8_t bench_binary_commands[BENCH_COMMAND_COUNT][LIGHT_BINARY_LEN] = {
+    { LIGHT_BINARY_VERSION, LIGHT_BINARY_STATE | LIGHT_BINARY_BRIGHTNESS,
+      1, 0, LE16(1834), LE16(0), LE16(0), LE16(0), LE16(0), LE32(0) },
+    { LIGHT_BINARY_VERSION, LIGHT_BINARY_STATE | LIGHT_BINARY_COLOR,
+      1, 0, LE16(0), LE16(4095), LE16(1200), LE16(0), LE16(0), LE32(0) },
+    { LIGHT_BINARY_VERSION, LIGHT_BINARY_STATE | LIGHT_BINARY_EFFECT | LIGHT_BINARY_TRANSITION,
+      1, 1, LE16(0), LE16(0), LE16(0), LE16(0), LE16(0), LE32(500) },
+    { LIGHT_BINARY_VERSION, LIGHT_BINARY_STATE | LIGHT_BINARY_BRIGHTNESS | LIGHT_BINARY_COLOR |
+      LIGHT_BINARY_EFFECT | LIGHT_BINARY_TRANSITION,
+      1, 0, LE16(4095), LE16(255), LE16(128), LE16(64), LE16(512), LE32(2000) },
+    { LIGHT_BINARY_VERSION, LIGHT_BINARY_STATE,
+      0, 0, LE16(0), LE16(0), LE16(0), LE16(0), LE16(0), LE32(0) },
+};
+
+// Heap use of cJSON, counted through its allocation hooks
+static uint32_t cjson_allocations = 0;
+static uint64_t cjson_allocated_bytes = 0;
+
+static void *counting_malloc(size_t size)
+{
+    cjson_allocations++;
+    cjson_allocated_bytes += size;
+    return malloc(size);
+}
+
+// parse_mqtt_message() as it was before light_json, kept as the baseline
+static bool cjson_parse_command(const char *payload, light_state_t *state, uint32_t *transition_ms)
+{
+    cJSON *root = cJSON_Parse(payload);
+    if (root == NULL) {
+        return false;
+    }
+
+    // Always check and set state
+    cJSON *state_json = cJSON_GetObjectItemCaseSensitive(root, "state");
+    if (cJSON_IsString(state_json) && (state_json->valuestring != NULL)) {
+        state->is_on = (strcmp(state_json->valuestring, "ON") == 0);
+    }
+
+    // Color parsing - only update if color is present
+    cJSON *color_json = cJSON_GetObjectItemCaseSensitive(root, "color");
+    if (cJSON_IsObject(color_json)) {
+        cJSON *r = cJSON_GetObjectItemCaseSensitive(color_json, "r");
+        cJSON *g = cJSON_GetObjectItemCaseSensitive(color_json, "g");
+        cJSON *b = cJSON_GetObjectItemCaseSensitive(color_json, "b");
+        cJSON *w = cJSON_GetObjectItemCaseSensitive(color_json, "w");
+
+        state->r = cJSON_IsNumber(r) ? r->valueint : state->r;
+        state->g = cJSON_IsNumber(g) ? g->valueint : state->g;
+        state->b = cJSON_IsNumber(b) ? b->valueint : state->b;
+        state->w = cJSON_IsNumber(w) ? w->valueint : state->w;
+    }
+
+    // Brightness parsing
+    cJSON *brightness_json = cJSON_GetObjectItemCaseSensitive(root, "brightness");
+    state->brightness = cJSON_IsNumber(brightness_json) ? 
+                        brightness_json->valueint : state->brightness;
+
+    // Effect parsing - unknown effect names are ignored
+    cJSON *effect_json = cJSON_GetObjectItemCaseSensitive(root, "effect");
+    if (cJSON_IsString(effect_json) && (effect_json->valuestring != NULL)) {
+        int effect = led_effects_find(effect_json->valuestring);
+        if (effect >= 0) {
+            state->effect = (uint8_t)effect;
+        } else {
+            ESP_LOGW(TAG, "Unknown effect: %s", effect_json->valuestring);
+        }
+    }
+
+    // Transition is given in seconds
+    cJSON *transition_json = cJSON_GetObjectItemCaseSensitive(root, "transition");
+    if (cJSON_IsNumber(transition_json) && transition_json->valuedouble > 0) {
+        *transition_ms = (uint32_t)(transition_json->valuedouble * 1000);
+    }
+
+    cJSON_Delete(root);
+    return true;
+}
+
+typedef bool (*bench_parser_t)(const char *payload, size_t len, light_state_t *state, uint32_t *transition_ms);
+
+static bool bench_parse_cjson(const char *payload, size_t len, light_state_t *state, uint32_t *transition_ms)
+{
+    return cjson_parse_command(payload, state, transition_ms);
+}
+
+static bool bench_parse_binary(const char *payload, size_t len, light_state_t *state, uint32_t *transition_ms)
+{
+    return light_binary_parse_command((const uint8_t *)payload, len, state, transition_ms);
+}
+
+// Parse the commands until the case has run long enough
+// binary selects bench_binary_commands instead of the JSON ones
+static void bench_parser(const char *name, bench_parser_t parse, bool binary)
+{
+    light_state_t state = { 0 };
+    uint32_t transition_ms = 0;
+    uint32_t commands = 0;
+    const char *payloads[BENCH_COMMAND_COUNT];
+    size_t lengths[BENCH_COMMAND_COUNT];
+    for (size_t i = 0; i < BENCH_COMMAND_COUNT; i++) {
+        payloads[i] = binary ? (const char *)bench_binary_commands[i] : bench_commands[i];
+        lengths[i] = binary ? LIGHT_BINARY_LEN : strlen(bench_commands[i]);
+    }
+
+    cjson_allocations = 0;
+    cjson_allocated_bytes = 0;
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed;
+    do {
+        for (size_t i = 0; i < BENCH_COMMAND_COUNT; i++) {
+            if (!parse(payloads[i], lengths[i], &state, &transition_ms)) {
+                ESP_LOGE(TAG, "%s rejected %s", name, bench_commands[i]);
+                return;
+            }
+        }
+        commands += BENCH_COMMAND_COUNT;
+        elapsed = esp_timer_get_time() - start;
+    } while (elapsed < BENCH_MIN_US);
+
+    printf("%-12s %12" PRIu64 " %10" PRIu64 " %12" PRIu64 " %14" PRIu64 "\n", name,
+           (uint64_t)commands * 1000000 / elapsed,
+           (uint64_t)elapsed * 1000 / commands,
+           (uint64_t)cjson_allocations / commands,
+           cjson_allocated_bytes / commands);
+}
+
+// publish_init_state() payload as it was before light_json, kept as the baseline
+// The caller frees the returned string with cJSON_free()
+static char *cjson_print_state(const light_state_t *stLightState)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "state", stLightState->is_on ? "ON" : "OFF");
+    cJSON_AddNumberToObject(root, "brightness", stLightState->brightness);
+    cJSON *color = cJSON_CreateObject();
+    cJSON_AddNumberToObject(color, "r", stLightState->r);
+    cJSON_AddNumberToObject(color, "g", stLightState->g);
+    cJSON_AddNumberToObject(color, "b", stLightState->b);
+    cJSON_AddNumberToObject(color, "w", stLightState->w);
+    cJSON_AddItemToObject(root, "color", color);
+    const led_effect_t *effect = led_effects_get(stLightState->effect);
+    if (effect != NULL) {
+        cJSON_AddStringToObject(root, "effect", effect->name);
+    }
+    char *payload = cJSON_Print(root);
+    cJSON_Delete(root);
+    return payload;
+}
+
+// Render state payloads until the case has run long enough
+static void bench_writer(const char *name, bool use_cjson)
+{
+    light_state_t state = {
+        .is_on = true,
+        .r = 4095,
+        .g = 1200,
+        .b = 37,
+        .w = 512,
+        .brightness = 3071,
+        .effect = 1,
+    };
+    uint32_t publishes = 0;
+    size_t bytes = 0;
+
+    cjson_allocations = 0;
+    cjson_allocated_bytes = 0;
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed;
+    do {
+        // Vary the brightness like a slider drag
+        state.brightness = (uint16_t)(publishes & 0xFFF);
+        if (use_cjson) {
+            char *payload = cjson_print_state(&state);
+            bytes = strlen(payload);
+            cJSON_free(payload);
+        } else {
+            char payload[LIGHT_JSON_STATE_MAX_LEN];
+            bytes = light_json_write_state(&state, payload, sizeof(payload));
+        }
+        publishes++;
+        elapsed = esp_timer_get_time() - start;
+    } while (elapsed < BENCH_MIN_US);
+
+    printf("%-12s %12" PRIu64 " %10" PRIu64 " %12" PRIu64 " %14" PRIu64 " %8u\n", name,
+           (uint64_t)publishes * 1000000 / elapsed,
+           (uint64_t)elapsed * 1000 / publishes,
+           (uint64_t)cjson_allocations / publishes,
+           cjson_allocated_bytes / publishes,
+           (unsigned)bytes);
+}
+
+void bench_light_json(void)
+{
+    // Only cJSON goes through these hooks, light_json never calls the allocator
+    cJSON_Hooks hooks = { .malloc_fn = counting_malloc, .free_fn = free };
+    cJSON_InitHooks(&hooks);
+
+    printf("%-12s %12s %10s %12s %14s\n", "parser", "commands/s", "ns/cmd", "allocs/cmd", "bytes/cmd");
+    bench_parser("cJSON", bench_parse_cjson, false);
+    bench_parser("light_json", light_json_parse_command, false);
+    bench_parser("binary", bench_parse_binary, true);
+
+    printf("\n%-12s %12s %10s %12s %14s %8s\n", "writer", "publishes/s", "ns/publish", "allocs/pub", "bytes/pub", "payload");
+    bench_writer("cJSON_Print", true);
+    bench_writer("light_json", false);
+
+    cJSON_InitHooks(NULL);
+}
@@ -0,0 +1,55 @@
+#include "boot_timing.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include "esp_app_desc.h"
+#include "esp_timer.h"
+
+// Names in the diagnostics message, in boot_phase_t order
+static const char *phase_names[BOOT_PHASE_MAX] = {
+    "app_main", "nvs_init", "wifi_start", "got_ip", "mqtt_start", "mqtt_connected", "discovery", "first_frame",
+};
+
+// esp_timer starts with the boot, 0 marks a phase that was not reached
+static uint32_t phase_us[BOOT_PHASE_MAX];
+
+void boot_timing_mark(boot_phase_t phase) {
+    if (phase >= BOOT_PHASE_MAX) {
+        return;
+    }
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    uint32_t unset = 0;
+    __atomic_compare_exchange_n(&phase_us[phase], &unset, now > 0 ? now : 1, false,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+uint32_t boot_timing_get_us(boot_phase_t phase) {
+    return phase < BOOT_PHASE_MAX ? __atomic_load_n(&phase_us[phase], __ATOMIC_RELAXED) : 0;
+}
+
+size_t boot_timing_write_json(char *buf, size_t size) {
+    size_t len = 0;
+    int written = snprintf(buf, size, "{\"version\":\"%s\"", esp_app_get_description()->version);
+    if (written < 0 || (size_t)written >= size) {
+        return 0;
+    }
+    len = written;
+
+    for (int i = 0; i < BOOT_PHASE_MAX; i++) {
+        uint32_t us = boot_timing_get_us(i);
+        if (us == 0) {
+            continue;
+        }
+        written = snprintf(buf + len, size - len, ",\"%s\":%" PRIu32, phase_names[i], us / 1000);
+        if (written < 0 || (size_t)written >= size - len) {
+            return 0;
+        }
+        len += written;
+    }
+
+    if (len + 2 > size) {
+        return 0;
+    }
+    buf[len++] = '}';
+    buf[len] = '\0';
+    return len;
+}
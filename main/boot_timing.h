@@ -0,0 +1,36 @@
+#ifndef BOOT_TIMING_H
+#define BOOT_TIMING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Startup milestones, in the order they are expected
+typedef enum {
+    BOOT_APP_MAIN = 0,          // app_main() entered
+    BOOT_NVS_INIT,              // NVS and the device config loaded
+    BOOT_WIFI_START,            // Wi-Fi manager started
+    BOOT_GOT_IP,                // First IP address
+    BOOT_MQTT_START,            // MQTT client started
+    BOOT_MQTT_CONNECTED,        // First broker connection
+    BOOT_DISCOVERY_PUBLISHED,   // Discovery acknowledged, or found unchanged
+    BOOT_FIRST_FRAME,           // First frame sent to the strip
+    BOOT_PHASE_MAX
+} boot_phase_t;
+
+// Buffer size that fits any table written by boot_timing_write_json()
+#define BOOT_TIMING_JSON_MAX_LEN 256
+
+// Record the time since boot of a milestone, safe to call from any task
+// Only the first call per phase is kept, later ones (e.g. after a reconnect) are ignored
+void boot_timing_mark(boot_phase_t phase);
+
+// Time since boot of a milestone in microseconds, 0 if it was not reached yet
+uint32_t boot_timing_get_us(boot_phase_t phase);
+
+// Write the reached milestones as compact JSON in milliseconds since boot, null terminated, e.g.
+// {"version":"1.2.0","app_main":312,"nvs_init":341,...}
+// Returns the length without the terminator, or 0 if buf is too small
+size_t boot_timing_write_json(char *buf, size_t size);
+
+#endif // BOOT_TIMING_H
@@ -0,0 +1,281 @@
+#include "config_store.h"
+#include <string.h>
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "lightstate.h"
+#include "ledconfig.h"
+#include "device_config.h"
+
+#define NVS_NAMESPACE "device_cfg"
+
+// First byte of a record, the structs stored before the header existed never start with it
+#define RECORD_MAGIC 0xC5
+#define RECORD_MAX_SIZE 512
+
+static const char *TAG = "config_store";
+
+typedef struct record_schema record_schema_t;
+
+// Convert a record stored with an older schema version into the current struct
+// Returns false if the record cannot be converted, out must be left untouched then
+typedef bool (*record_migrate_t)(const record_schema_t *schema, uint8_t version,
+                                 const uint8_t *stored, size_t size, void *out);
+
+struct record_schema {
+    const char *name;
+    uint8_t version;            // Version written by this firmware
+    uint16_t size;              // Size of the struct of that version
+    record_migrate_t migrate;   // NULL if older versions are dropped
+};
+
+// Version 0 is the bare struct written before records had a header
+// These layouts are unchanged since, so the size is all there is to check
+static bool migrate_unversioned(const record_schema_t *schema, uint8_t version,
+                                const uint8_t *stored, size_t size, void *out) {
+    if (version != 0 || size != schema->size) {
+        return false;
+    }
+    memcpy(out, stored, size);
+    return true;
+}
+
+// light_state_t as first stored, before it had an effect
+typedef struct {
+    bool is_on;
+    uint16_t r;
+    uint16_t g;
+    uint16_t b;
+    uint16_t w;
+    uint16_t brightness;
+} light_state_legacy_t;
+
+// Unversioned light states come with or without the effect, depending on the firmware that wrote them
+static bool migrate_light_state(const record_schema_t *schema, uint8_t version,
+                                const uint8_t *stored, size_t size, void *out) {
+    if (version != 0) {
+        return false;
+    }
+    if (size == schema->size) {
+        memcpy(out, stored, size);
+        return true;
+    }
+    if (size != sizeof(light_state_legacy_t)) {
+        return false;
+    }
+    light_state_legacy_t legacy;
+    memcpy(&legacy, stored, sizeof(legacy));
+    light_state_t *state = out;
+    state->is_on = legacy.is_on;
+    state->r = legacy.r;
+    state->g = legacy.g;
+    state->b = legacy.b;
+    state->w = legacy.w;
+    state->brightness = legacy.brightness;
+    state->effect = 0;
+    return true;
+}
+
+// In config_record_type_t order
+// Bump the version when a struct changes and teach its migrate hook the old layout
+static const record_schema_t schemas[CONFIG_RECORD_TYPE_MAX] = {
+    { "light state", 1, sizeof(light_state_t),        migrate_light_state },
+    { "LED config",  1, sizeof(led_hw_config_t),      migrate_unversioned },
+    { "segments",    1, sizeof(led_segment_layout_t), migrate_unversioned },
+    { "preset",      1, sizeof(light_preset_t),       NULL },
+};
+
+_Static_assert(sizeof(led_segment_layout_t) + CONFIG_STORE_HEADER_SIZE <= RECORD_MAX_SIZE,
+               "segment layout must fit a record");
+_Static_assert(sizeof(light_preset_t) + CONFIG_STORE_HEADER_SIZE <= RECORD_MAX_SIZE,
+               "preset must fit a record");
+
+static nvs_handle_t store_handle;
+static SemaphoreHandle_t store_lock = NULL;     // Recursive, held for a whole batch
+static int batch_depth = 0;
+static esp_err_t batch_error = ESP_OK;          // First failed write of the batch
+static uint8_t record_buf[RECORD_MAX_SIZE];     // Guarded by store_lock
+
+bool config_store_init(void) {
+    if (store_lock != NULL) {
+        return true;
+    }
+
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        // NVS partition was truncated and needs to be erased
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(err);
+
+    // Kept open for the lifetime of the firmware
+    err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &store_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    store_lock = xSemaphoreCreateRecursiveMutex();
+    if (store_lock == NULL) {
+        nvs_close(store_handle);
+        return false;
+    }
+    return true;
+}
+
+// Copy a stored record into data, converting older versions
+static esp_err_t decode_record(const record_schema_t *schema, const char *key,
+                               const uint8_t *buf, size_t size, void *data) {
+    uint8_t version = 0;
+    const uint8_t *stored = buf;
+    size_t stored_size = size;
+    if (size >= CONFIG_STORE_HEADER_SIZE && buf[0] == RECORD_MAGIC) {
+        version = buf[1];
+        stored = buf + CONFIG_STORE_HEADER_SIZE;
+        stored_size = buf[2] | (buf[3] << 8);
+        if (stored_size != size - CONFIG_STORE_HEADER_SIZE) {
+            ESP_LOGE(TAG, "Truncated %s record %s", schema->name, key);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (version == schema->version) {
+            if (stored_size != schema->size) {
+                ESP_LOGE(TAG, "%s record %s has the wrong size", schema->name, key);
+                return ESP_ERR_INVALID_SIZE;
+            }
+            memcpy(data, stored, stored_size);
+            return ESP_OK;
+        }
+    }
+
+    if (version > schema->version || schema->migrate == NULL ||
+        !schema->migrate(schema, version, stored, stored_size, data)) {
+        ESP_LOGW(TAG, "Dropped %s record %s of version %u", schema->name, key, version);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    ESP_LOGI(TAG, "Migrated %s record %s from version %u to %u", schema->name, key, version, schema->version);
+    return ESP_OK;
+}
+
+esp_err_t config_store_get(config_record_type_t type, const char *key, void *data) {
+    if (type >= CONFIG_RECORD_TYPE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (store_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTakeRecursive(store_lock, portMAX_DELAY);
+    size_t size = sizeof(record_buf);
+    esp_err_t err = nvs_get_blob(store_handle, key, record_buf, &size);
+    if (err == ESP_OK) {
+        err = decode_record(&schemas[type], key, record_buf, size, data);
+    }
+    xSemaphoreGiveRecursive(store_lock);
+    return err;
+}
+
+esp_err_t config_store_get_str(const char *key, char *value, size_t size) {
+    if (store_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTakeRecursive(store_lock, portMAX_DELAY);
+    esp_err_t err = nvs_get_str(store_handle, key, value, &size);
+    xSemaphoreGiveRecursive(store_lock);
+    return err;
+}
+
+esp_err_t config_store_get_u32(const char *key, uint32_t *value) {
+    if (store_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTakeRecursive(store_lock, portMAX_DELAY);
+    esp_err_t err = nvs_get_u32(store_handle, key, value);
+    xSemaphoreGiveRecursive(store_lock);
+    return err;
+}
+
+void config_store_begin(void) {
+    if (store_lock == NULL) {
+        return;
+    }
+    xSemaphoreTakeRecursive(store_lock, portMAX_DELAY);
+    if (batch_depth++ == 0) {
+        batch_error = ESP_OK;
+    }
+}
+
+// Remember the first failed write, the commit reports it
+static esp_err_t batch_result(esp_err_t err, const char *key) {
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error writing %s: %s", key, esp_err_to_name(err));
+        if (batch_error == ESP_OK) {
+            batch_error = err;
+        }
+    }
+    return err;
+}
+
+esp_err_t config_store_set(config_record_type_t type, const char *key, const void *data) {
+    if (type >= CONFIG_RECORD_TYPE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (store_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const record_schema_t *schema = &schemas[type];
+    xSemaphoreTakeRecursive(store_lock, portMAX_DELAY);
+    record_buf[0] = RECORD_MAGIC;
+    record_buf[1] = schema->version;
+    record_buf[2] = (uint8_t)schema->size;
+    record_buf[3] = (uint8_t)(schema->size >> 8);
+    memcpy(record_buf + CONFIG_STORE_HEADER_SIZE, data, schema->size);
+    esp_err_t err = nvs_set_blob(store_handle, key, record_buf, CONFIG_STORE_HEADER_SIZE + schema->size);
+    err = batch_result(err, key);
+    xSemaphoreGiveRecursive(store_lock);
+    return err;
+}
+
+esp_err_t config_store_set_str(const char *key, const char *value) {
+    if (store_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTakeRecursive(store_lock, portMAX_DELAY);
+    esp_err_t err = batch_result(nvs_set_str(store_handle, key, value), key);
+    xSemaphoreGiveRecursive(store_lock);
+    return err;
+}
+
+esp_err_t config_store_set_u32(const char *key, uint32_t value) {
+    if (store_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTakeRecursive(store_lock, portMAX_DELAY);
+    esp_err_t err = batch_result(nvs_set_u32(store_handle, key, value), key);
+    xSemaphoreGiveRecursive(store_lock);
+    return err;
+}
+
+esp_err_t config_store_commit(void) {
+    if (store_lock == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = ESP_OK;
+    // A nested batch is committed by the outermost one
+    if (--batch_depth == 0) {
+        // The writes that succeeded are committed even if another one failed
+        err = nvs_commit(store_handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error committing NVS data: %s", esp_err_to_name(err));
+        }
+        if (batch_error != ESP_OK) {
+            err = batch_error;
+        }
+    }
+    xSemaphoreGiveRecursive(store_lock);
+    return err;
+}
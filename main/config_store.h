@@ -0,0 +1,52 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Everything the device keeps in NVS goes through here, over one handle opened at init
+// Structs are stored as typed records with a schema version, so a layout change
+// migrates or drops the old record instead of reading it as the new layout
+
+// Record types, each with its struct and schema version in config_store.c
+typedef enum {
+    CONFIG_RECORD_LIGHT_STATE = 0,  // light_state_t
+    CONFIG_RECORD_LED_CONFIG,       // led_hw_config_t
+    CONFIG_RECORD_SEGMENTS,         // led_segment_layout_t
+    CONFIG_RECORD_PRESET,           // light_preset_t
+    CONFIG_RECORD_TYPE_MAX
+} config_record_type_t;
+
+// Bytes in front of every record: magic, schema version and payload size
+#define CONFIG_STORE_HEADER_SIZE 4
+
+// Initialize NVS and open the handle, erasing the partition if it has to be reformatted
+// Returns true on success
+bool config_store_init(void);
+
+// Read a record, converting it if an older schema version was stored
+// data must hold the struct of the record type
+// Returns ESP_OK, ESP_ERR_NVS_NOT_FOUND if there is no record, or
+// ESP_ERR_INVALID_VERSION if it cannot be converted; data is only written on ESP_OK
+esp_err_t config_store_get(config_record_type_t type, const char *key, void *data);
+
+// Read a string or a number, same returns as config_store_get()
+esp_err_t config_store_get_str(const char *key, char *value, size_t size);
+esp_err_t config_store_get_u32(const char *key, uint32_t *value);
+
+// Start a batch, the writes until config_store_commit() share one nvs_commit
+// Other tasks wait for the batch to finish before they can use the store
+void config_store_begin(void);
+
+// Write a record or value as part of the current batch
+esp_err_t config_store_set(config_record_type_t type, const char *key, const void *data);
+esp_err_t config_store_set_str(const char *key, const char *value);
+esp_err_t config_store_set_u32(const char *key, uint32_t value);
+
+// Commit the writes of the batch and end it, the successful writes are committed even if another failed
+// Returns the result of the first failed write, or else of the commit
+esp_err_t config_store_commit(void);
+
+#endif // CONFIG_STORE_H
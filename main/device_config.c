@@ -1,29 +1,276 @@
 #include "device_config.h"
 #include "esp_log.h"
-#include "nvs_flash.h"
-#include "nvs.h"
+#include "config_store.h"
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include "esp_attr.h"
 #include "esp_mac.h"
 #include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #define DEVICE_ID_KEY "device_id"
 #define LIGHT_STATE_KEY "light_state"
+#define LED_CONFIG_KEY "led_config"
+#define SEGMENTS_KEY "segments"
+#define DISCOVERY_HASH_KEY "disc_hash"
+#define PRESET_KEY "preset"
 #define DEVICE_ID_LENGTH 6
-#define NVS_NAMESPACE "device_cfg"
+
+// Longest a constantly changing light state stays unwritten
+#define PERSIST_MAX_DELAY_MS 30000
+#define PERSIST_TASK_STACK_SIZE 3072
+
+// Flash used by one record write: the blob index entry, the data header entry
+// and the record itself, in 32 byte NVS entries
+#define NVS_ENTRY_SIZE 32
+#define NVS_RECORD_FLASH_BYTES(size) \
+    ((2 + ((size) + CONFIG_STORE_HEADER_SIZE + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE) * NVS_ENTRY_SIZE)
+
+// Identifies the RTC mirror layout, bump the version when rtc_mirror_t changes
+#define RTC_MIRROR_MAGIC 0x41494F54
+#define RTC_MIRROR_VERSION 1
 
 static const char *TAG = "device_config";
 static char device_id[DEVICE_ID_LENGTH + 1]; // +1 for null terminator
-static light_state_t current_light_state = {
-    .is_on = false,
-    .r = 0,
-    .g = 0,
-    .b = 0,
-    .w = 0,
-    .brightness = 0
+static light_state_t current_light_states[CONFIG_LED_MAX_SEGMENTS];
+static uint32_t discovery_hash = 0;
+
+// Write-behind persistence of the light states
+// current_light_states is the latest requested state, stored_light_states what flash holds
+static light_state_t stored_light_states[CONFIG_LED_MAX_SEGMENTS];
+static uint32_t persist_dirty = 0;      // Bit per segment with an unwritten state
+static device_config_persist_stats_t persist_stats;
+static SemaphoreHandle_t persist_lock = NULL;         // Guards the fields above
+static SemaphoreHandle_t persist_write_lock = NULL;   // Held while writing to NVS
+static TaskHandle_t persist_task_handle = NULL;
+// Preset slots, read from NVS on first use
+static light_preset_t presets[CONFIG_LIGHT_PRESET_COUNT];
+static bool presets_loaded = false;                 // Set once every slot has been read
+static SemaphoreHandle_t preset_load_lock = NULL;   // Held while the slots are read
+
+static led_hw_config_t current_led_config = {
+    .gpio = CONFIG_LED_GPIO,
+    .chip = LED_CHIP_WS2812B,
+    .color_order = LED_ORDER_GRB,
+    .led_count = CONFIG_LED_COUNT
 };
 
+static led_segment_layout_t current_segments = {
+    .count = 1,
+    .segments = { { .start = 0, .count = CONFIG_LED_COUNT } }
+};
+
+// Copy of the config in RTC memory, it survives soft resets and deep sleep but not a power cycle
+// Restoring from it skips every flash read, the CRC tells it apart from leftover contents
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    char device_id[DEVICE_ID_LENGTH + 1];
+    led_hw_config_t led_config;         // Config for the next boot, like the one in NVS
+    led_segment_layout_t segments;
+    uint32_t discovery_hash;
+    uint32_t unsaved;                   // Bit per segment whose light state NVS does not hold yet
+    light_state_t light_states[CONFIG_LED_MAX_SEGMENTS];
+    uint32_t crc;                       // Over everything above
+} rtc_mirror_t;
+
+static RTC_NOINIT_ATTR rtc_mirror_t rtc_mirror;
+
+static bool led_config_is_valid(const led_hw_config_t* config) {
+    return GPIO_IS_VALID_OUTPUT_GPIO(config->gpio) &&
+           config->chip < LED_CHIP_MAX &&
+           config->color_order < LED_ORDER_MAX &&
+           config->led_count > 0 && config->led_count <= CONFIG_LED_MAX_COUNT;
+}
+
+// Segments must lie on the strip and must not overlap
+static bool segments_are_valid(const led_segment_layout_t* layout, const led_hw_config_t* config) {
+    if (layout->count == 0 || layout->count > CONFIG_LED_MAX_SEGMENTS) {
+        return false;
+    }
+    for (int i = 0; i < layout->count; i++) {
+        const led_segment_t *a = &layout->segments[i];
+        if (a->count == 0 || a->start + a->count > config->led_count ||
+            strnlen(a->name, LED_SEGMENT_NAME_LEN) == LED_SEGMENT_NAME_LEN) {
+            return false;
+        }
+        for (int j = 0; j < i; j++) {
+            const led_segment_t *b = &layout->segments[j];
+            if (a->start < b->start + b->count && b->start < a->start + a->count) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// One unnamed segment spanning the whole strip
+static void default_segments(led_segment_layout_t* layout, const led_hw_config_t* config) {
+    memset(layout, 0, sizeof(led_segment_layout_t));
+    layout->count = 1;
+    layout->segments[0].count = config->led_count;
+}
+
+static uint32_t rtc_mirror_crc(void) {
+    return esp_rom_crc32_le(0, (const uint8_t *)&rtc_mirror, offsetof(rtc_mirror_t, crc));
+}
+
+// Update the CRC after changing the mirror, once the writer runs the caller holds persist_lock
+static void rtc_mirror_seal(void) {
+    rtc_mirror.crc = rtc_mirror_crc();
+}
+
+// Take the config from the RTC mirror if it survived the reset intact
+// Returns false if it has to be loaded from NVS
+static bool rtc_mirror_restore(void) {
+    // RTC memory is random after power-on, a matching CRC would only be chance
+    esp_reset_reason_t reason = esp_reset_reason();
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_UNKNOWN) {
+        return false;
+    }
+    if (rtc_mirror.magic != RTC_MIRROR_MAGIC || rtc_mirror.version != RTC_MIRROR_VERSION ||
+        rtc_mirror.size != sizeof(rtc_mirror_t) || rtc_mirror.crc != rtc_mirror_crc()) {
+        ESP_LOGI(TAG, "No valid RTC mirror, loading the config from NVS");
+        return false;
+    }
+    if (rtc_mirror.device_id[0] == '\0' || !led_config_is_valid(&rtc_mirror.led_config) ||
+        !segments_are_valid(&rtc_mirror.segments, &rtc_mirror.led_config)) {
+        ESP_LOGW(TAG, "RTC mirror holds an invalid config, loading the config from NVS");
+        return false;
+    }
+
+    memcpy(device_id, rtc_mirror.device_id, sizeof(device_id));
+    memcpy(&current_led_config, &rtc_mirror.led_config, sizeof(led_hw_config_t));
+    memcpy(&current_segments, &rtc_mirror.segments, sizeof(led_segment_layout_t));
+    discovery_hash = rtc_mirror.discovery_hash;
+    memcpy(current_light_states, rtc_mirror.light_states, sizeof(current_light_states));
+    ESP_LOGI(TAG, "Restored device %s and %d segments from RTC memory", device_id, current_segments.count);
+    return true;
+}
+
+// Fill the mirror with the config loaded from NVS
+static void rtc_mirror_capture(void) {
+    memset(&rtc_mirror, 0, sizeof(rtc_mirror));
+    rtc_mirror.magic = RTC_MIRROR_MAGIC;
+    rtc_mirror.version = RTC_MIRROR_VERSION;
+    rtc_mirror.size = sizeof(rtc_mirror_t);
+    memcpy(rtc_mirror.device_id, device_id, sizeof(device_id));
+    memcpy(&rtc_mirror.led_config, &current_led_config, sizeof(led_hw_config_t));
+    memcpy(&rtc_mirror.segments, &current_segments, sizeof(led_segment_layout_t));
+    rtc_mirror.discovery_hash = discovery_hash;
+    memcpy(rtc_mirror.light_states, current_light_states, sizeof(rtc_mirror.light_states));
+    rtc_mirror_seal();
+}
+
+// NVS key of the light state of a segment, segment 0 keeps the original key
+static void light_state_key(int segment, char *key, size_t len) {
+    if (segment == 0) {
+        snprintf(key, len, "%s", LIGHT_STATE_KEY);
+    } else {
+        snprintf(key, len, "%s_%d", LIGHT_STATE_KEY, segment);
+    }
+}
+
+// Add the light state of a segment to the current batch, unless flash already holds the same state
+// Returns true if it was written
+static bool persist_light_state(int segment, const light_state_t *state) {
+    if (memcmp(state, &stored_light_states[segment], sizeof(light_state_t)) == 0) {
+        xSemaphoreTake(persist_lock, portMAX_DELAY);
+        persist_stats.skipped++;
+        xSemaphoreGive(persist_lock);
+        return false;
+    }
+
+    char key[16];
+    light_state_key(segment, key, sizeof(key));
+    return config_store_set(CONFIG_RECORD_LIGHT_STATE, key, state) == ESP_OK;
+}
+
+// Write every light state changed since the last call to NVS, with one commit
+// Only stored_light_states is touched while writing, requests are not blocked by the flash
+static void persist_dirty_states(void) {
+    if (persist_write_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(persist_write_lock, portMAX_DELAY);
+
+    xSemaphoreTake(persist_lock, portMAX_DELAY);
+    uint32_t dirty = persist_dirty;
+    persist_dirty = 0;
+    light_state_t states[CONFIG_LED_MAX_SEGMENTS];
+    memcpy(states, current_light_states, sizeof(states));
+    xSemaphoreGive(persist_lock);
+
+    uint32_t written = 0;
+    if (dirty != 0) {
+        config_store_begin();
+        for (int i = 0; i < CONFIG_LED_MAX_SEGMENTS; i++) {
+            if ((dirty & (1u << i)) && persist_light_state(i, &states[i])) {
+                written |= 1u << i;
+            }
+        }
+        if (config_store_commit() != ESP_OK) {
+            written = 0;
+        }
+    }
+
+    if (written != 0) {
+        xSemaphoreTake(persist_lock, portMAX_DELAY);
+        persist_stats.commits++;
+        // A segment changed again during the write is still unsaved, NVS holds the older state
+        rtc_mirror.unsaved &= ~(written & ~persist_dirty);
+        rtc_mirror_seal();
+        xSemaphoreGive(persist_lock);
+    }
+    for (int i = 0; i < CONFIG_LED_MAX_SEGMENTS; i++) {
+        if (!(written & (1u << i))) {
+            continue;
+        }
+        const light_state_t *state = &states[i];
+        memcpy(&stored_light_states[i], state, sizeof(light_state_t));
+        xSemaphoreTake(persist_lock, portMAX_DELAY);
+        persist_stats.bytes_written += NVS_RECORD_FLASH_BYTES(sizeof(light_state_t));
+        xSemaphoreGive(persist_lock);
+
+        ESP_LOGI(TAG, "Stored light state %d - On: %d, R: %d, G: %d, B: %d, W: %d, Brightness: %d", i,
+                state->is_on, state->r, state->g, state->b, state->w, state->brightness);
+    }
+
+    // Running totals, for estimating the flash wear of the light states
+    if (written != 0) {
+        device_config_persist_stats_t totals;
+        device_config_get_persist_stats(&totals);
+        ESP_LOGI(TAG, "Light state writes: %" PRIu32 " requests, %" PRIu32 " commits, %" PRIu32 " skipped, %" PRIu32 " bytes",
+                 totals.requests, totals.commits, totals.skipped, totals.bytes_written);
+    }
+
+    xSemaphoreGive(persist_write_lock);
+}
+
+// Low priority worker that writes light states once they stop changing
+// A state that keeps changing is still written every PERSIST_MAX_DELAY_MS
+static void persist_task(void *pvParameters) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        TickType_t first_request = xTaskGetTickCount();
+        while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_LIGHT_STATE_PERSIST_DELAY_MS)) > 0) {
+            if (xTaskGetTickCount() - first_request >= pdMS_TO_TICKS(PERSIST_MAX_DELAY_MS)) {
+                break;
+            }
+        }
+        persist_dirty_states();
+    }
+}
+
 // Generate a random alphanumeric string for device ID
 void device_config_generate_id(void) {
     //Get the base MAC address from different sources
@@ -63,71 +310,130 @@ void device_config_generate_id(void) {
     
 }
 
-bool device_config_init(void) {
+// Load the device ID, LED config, segments, discovery hash and light states from NVS
+// Returns false if the device ID can neither be read nor created
+static bool load_from_store(void) {
     esp_err_t err;
-    
-    // Initialize NVS
-    err = nvs_flash_init();
-    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        // NVS partition was truncated and needs to be erased
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        err = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(err);
-    
-    nvs_handle_t nvs_handle;
-    err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
-        return false;
-    }
-    
+
     // Try to load the device ID
-    size_t required_size = sizeof(device_id);
-    err = nvs_get_str(nvs_handle, DEVICE_ID_KEY, device_id, &required_size);
+    err = config_store_get_str(DEVICE_ID_KEY, device_id, sizeof(device_id));
     
     if (err == ESP_ERR_NVS_NOT_FOUND) {
         // Generate and store a new device ID
         device_config_generate_id();
-        err = nvs_set_str(nvs_handle, DEVICE_ID_KEY, device_id);
+        config_store_begin();
+        config_store_set_str(DEVICE_ID_KEY, device_id);
+        err = config_store_commit();
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "Error storing device ID: %s", esp_err_to_name(err));
-            nvs_close(nvs_handle);
-            return false;
-        }
-        
-        // Commit changes to NVS
-        err = nvs_commit(nvs_handle);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Error committing NVS: %s", esp_err_to_name(err));
-            nvs_close(nvs_handle);
             return false;
         }
         
         ESP_LOGI(TAG, "New device ID created and stored: %s", device_id);
     } else if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error reading device ID: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
         return false;
     } else {
         ESP_LOGI(TAG, "Loaded device ID: %s", device_id);
     }
     
-    // Try to load the light state
-    size_t light_state_size = sizeof(light_state_t);
-    err = nvs_get_blob(nvs_handle, LIGHT_STATE_KEY, &current_light_state, &light_state_size);
-    
+    // Try to load the LED hardware configuration
+    led_hw_config_t led_config;
+    err = config_store_get(CONFIG_RECORD_LED_CONFIG, LED_CONFIG_KEY, &led_config);
+
     if (err == ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGI(TAG, "No saved light state found, using defaults");
+        ESP_LOGI(TAG, "No saved LED config found, using defaults");
     } else if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error reading light state: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Error reading LED config: %s", esp_err_to_name(err));
+    } else if (!led_config_is_valid(&led_config)) {
+        ESP_LOGE(TAG, "Saved LED config is invalid, using defaults");
     } else {
-        ESP_LOGI(TAG, "Loaded light state - On: %d, R: %d, G: %d, B: %d, W: %d, Brightness: %d",
-                current_light_state.is_on, current_light_state.r, current_light_state.g,
-                current_light_state.b, current_light_state.w, current_light_state.brightness);
+        memcpy(&current_led_config, &led_config, sizeof(led_hw_config_t));
+    }
+    ESP_LOGI(TAG, "LED config - GPIO: %d, Chip: %d, Order: %d, Count: %d",
+            current_led_config.gpio, current_led_config.chip,
+            current_led_config.color_order, current_led_config.led_count);
+
+    // Try to load the segment layout, it has to fit the LED config
+    led_segment_layout_t segments;
+    err = config_store_get(CONFIG_RECORD_SEGMENTS, SEGMENTS_KEY, &segments);
+
+    if (err == ESP_OK && segments_are_valid(&segments, &current_led_config)) {
+        memcpy(&current_segments, &segments, sizeof(led_segment_layout_t));
+    } else {
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGE(TAG, "Saved segment layout is invalid, using the whole strip");
+        }
+        default_segments(&current_segments, &current_led_config);
+    }
+    for (int i = 0; i < current_segments.count; i++) {
+        ESP_LOGI(TAG, "Segment %d \"%s\" - Start: %d, Count: %d", i, current_segments.segments[i].name,
+                current_segments.segments[i].start, current_segments.segments[i].count);
+    }
+
+    // Hash of the last discovery payloads the broker acknowledged, 0 if never published
+    err = config_store_get_u32(DISCOVERY_HASH_KEY, &discovery_hash);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "Error reading discovery hash: %s", esp_err_to_name(err));
+    }
+
+    // Try to load the light state of every segment
+    for (int i = 0; i < current_segments.count; i++) {
+        char key[16];
+        light_state_key(i, key, sizeof(key));
+        light_state_t *light_state = &current_light_states[i];
+        err = config_store_get(CONFIG_RECORD_LIGHT_STATE, key, light_state);
+
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGI(TAG, "No saved light state found for segment %d, using defaults", i);
+        } else if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error reading light state of segment %d: %s", i, esp_err_to_name(err));
+        } else {
+            ESP_LOGI(TAG, "Loaded light state %d - On: %d, R: %d, G: %d, B: %d, W: %d, Brightness: %d", i,
+                    light_state->is_on, light_state->r, light_state->g,
+                    light_state->b, light_state->w, light_state->brightness);
+        }
+    }
+    return true;
+}
+
+bool device_config_init(void) {
+    // After a soft reset or deep sleep the RTC mirror holds everything, without reading flash
+    bool restored = rtc_mirror_restore();
+
+    // Initialize NVS, the store keeps its handle open from here on
+    if (!config_store_init()) {
+        ESP_LOGE(TAG, "Error opening the config store");
+        return false;
+    }
+
+    if (!restored) {
+        if (!load_from_store()) {
+            return false;
+        }
+        rtc_mirror_capture();
+    }
+
+    // A state the writer had not saved before the reset is written again
+    memcpy(stored_light_states, current_light_states, sizeof(stored_light_states));
+    persist_dirty = rtc_mirror.unsaved;
+    for (int i = 0; i < CONFIG_LED_MAX_SEGMENTS; i++) {
+        if (persist_dirty & (1u << i)) {
+            memset(&stored_light_states[i], 0xFF, sizeof(light_state_t));
+        }
+    }
+
+    persist_lock = xSemaphoreCreateMutex();
+    persist_write_lock = xSemaphoreCreateMutex();
+    preset_load_lock = xSemaphoreCreateMutex();
+    if (persist_lock == NULL || persist_write_lock == NULL || preset_load_lock == NULL ||
+        xTaskCreate(&persist_task, "persist", PERSIST_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY + 1, &persist_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start the light state writer");
+        return false;
+    }
+    if (persist_dirty != 0) {
+        xTaskNotifyGive(persist_task_handle);
     }
-    
-    nvs_close(nvs_handle);
     return true;
 }
 
@@ -135,41 +441,174 @@ char* device_config_get_id(void) {
     return device_id;
 }
 
-light_state_t* device_config_get_light_state(void) {
-    return &current_light_state;
+light_state_t* device_config_get_light_state(int segment) {
+    return &current_light_states[segment];
 }
 
-bool device_config_store_light_state(light_state_t* state) {
-    // Update our local copy
-    if (state != &current_light_state) {  // Don't copy if it's the same pointer
-        memcpy(&current_light_state, state, sizeof(light_state_t));
+bool device_config_store_light_state(int segment, light_state_t* state) {
+    if (segment < 0 || segment >= CONFIG_LED_MAX_SEGMENTS || persist_lock == NULL) {
+        return false;
     }
-    
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+
+    // Update our local copy, the worker writes it to flash once it stops changing
+    xSemaphoreTake(persist_lock, portMAX_DELAY);
+    if (state != &current_light_states[segment]) {  // Don't copy if it's the same pointer
+        memcpy(&current_light_states[segment], state, sizeof(light_state_t));
+    }
+    persist_dirty |= 1u << segment;
+    persist_stats.requests++;
+    memcpy(&rtc_mirror.light_states[segment], &current_light_states[segment], sizeof(light_state_t));
+    rtc_mirror.unsaved |= 1u << segment;
+    rtc_mirror_seal();
+    xSemaphoreGive(persist_lock);
+
+    if (persist_task_handle != NULL) {
+        xTaskNotifyGive(persist_task_handle);
+    }
+    return true;
+}
+
+void device_config_flush(void) {
+    persist_dirty_states();
+}
+
+void device_config_get_persist_stats(device_config_persist_stats_t *out) {
+    if (persist_lock == NULL) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(persist_lock, portMAX_DELAY);
+    *out = persist_stats;
+    xSemaphoreGive(persist_lock);
+}
+
+led_hw_config_t* device_config_get_led_config(void) {
+    return &current_led_config;
+}
+
+led_segment_layout_t* device_config_get_segments(void) {
+    return &current_segments;
+}
+
+bool device_config_store_led_config(const led_hw_config_t* config, const led_segment_layout_t* segments) {
+    if (!led_config_is_valid(config) || !segments_are_valid(segments, config)) {
+        ESP_LOGE(TAG, "Rejected invalid LED config");
+        return false;
+    }
+
+    // The running strip keeps the config it was started with, the new one is used after a reboot
+    // Both records go into one commit, so the layout always matches the config it was made for
+    config_store_begin();
+    config_store_set(CONFIG_RECORD_LED_CONFIG, LED_CONFIG_KEY, config);
+    config_store_set(CONFIG_RECORD_SEGMENTS, SEGMENTS_KEY, segments);
+    esp_err_t err = config_store_commit();
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error opening NVS handle: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Error storing LED config: %s", esp_err_to_name(err));
         return false;
     }
-    
-    err = nvs_set_blob(nvs_handle, LIGHT_STATE_KEY, &current_light_state, sizeof(light_state_t));
+
+    // A soft reset applies the new config from the mirror, just like a boot from NVS
+    if (persist_lock != NULL) {
+        xSemaphoreTake(persist_lock, portMAX_DELAY);
+    }
+    memcpy(&rtc_mirror.led_config, config, sizeof(led_hw_config_t));
+    memcpy(&rtc_mirror.segments, segments, sizeof(led_segment_layout_t));
+    rtc_mirror_seal();
+    if (persist_lock != NULL) {
+        xSemaphoreGive(persist_lock);
+    }
+
+    ESP_LOGI(TAG, "Stored LED config - GPIO: %d, Chip: %d, Order: %d, Count: %d, Segments: %d",
+            config->gpio, config->chip, config->color_order, config->led_count, segments->count);
+    return true;
+}
+
+// Read every preset slot, a slot without a valid record stays empty
+static void load_presets(void) {
+    for (int i = 0; i < CONFIG_LIGHT_PRESET_COUNT; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "%s_%d", PRESET_KEY, i);
+        light_preset_t preset;
+        esp_err_t err = config_store_get(CONFIG_RECORD_PRESET, key, &preset);
+        if (err == ESP_OK && preset.segment_count <= CONFIG_LED_MAX_SEGMENTS &&
+            strnlen(preset.name, LIGHT_PRESET_NAME_LEN) < LIGHT_PRESET_NAME_LEN) {
+            memcpy(&presets[i], &preset, sizeof(light_preset_t));
+        } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGE(TAG, "Error reading preset %d: %s", i, esp_err_to_name(err));
+        }
+    }
+}
+
+// Load the presets on first use, the MQTT task and the state publish timers may both get here first
+static void ensure_presets_loaded(void) {
+    if (__atomic_load_n(&presets_loaded, __ATOMIC_ACQUIRE) || preset_load_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(preset_load_lock, portMAX_DELAY);
+    if (!presets_loaded) {
+        load_presets();
+        __atomic_store_n(&presets_loaded, true, __ATOMIC_RELEASE);
+    }
+    xSemaphoreGive(preset_load_lock);
+}
+
+const light_preset_t* device_config_get_preset(int id) {
+    if (id < 0 || id >= CONFIG_LIGHT_PRESET_COUNT) {
+        return NULL;
+    }
+    ensure_presets_loaded();
+    return presets[id].segment_count > 0 ? &presets[id] : NULL;
+}
+
+bool device_config_store_preset(int id, const light_preset_t* preset) {
+    if (id < 0 || id >= CONFIG_LIGHT_PRESET_COUNT || preset->segment_count == 0 ||
+        preset->segment_count > CONFIG_LED_MAX_SEGMENTS ||
+        strnlen(preset->name, LIGHT_PRESET_NAME_LEN) == LIGHT_PRESET_NAME_LEN) {
+        ESP_LOGE(TAG, "Rejected invalid preset %d", id);
+        return false;
+    }
+    ensure_presets_loaded();
+
+    char key[16];
+    snprintf(key, sizeof(key), "%s_%d", PRESET_KEY, id);
+    config_store_begin();
+    config_store_set(CONFIG_RECORD_PRESET, key, preset);
+    esp_err_t err = config_store_commit();
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error storing light state: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
+        ESP_LOGE(TAG, "Error storing preset %d: %s", id, esp_err_to_name(err));
         return false;
     }
-    
-    err = nvs_commit(nvs_handle);
+    memcpy(&presets[id], preset, sizeof(light_preset_t));
+    ESP_LOGI(TAG, "Stored preset %d \"%s\" with %d segments", id, preset->name, preset->segment_count);
+    return true;
+}
+
+uint32_t device_config_get_discovery_hash(void) {
+    return discovery_hash;
+}
+
+bool device_config_store_discovery_hash(uint32_t hash) {
+    if (hash == discovery_hash) {
+        return true;
+    }
+
+    config_store_begin();
+    config_store_set_u32(DISCOVERY_HASH_KEY, hash);
+    esp_err_t err = config_store_commit();
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error committing NVS data: %s", esp_err_to_name(err));
-        nvs_close(nvs_handle);
+        ESP_LOGE(TAG, "Error storing discovery hash: %s", esp_err_to_name(err));
         return false;
     }
-    
-    ESP_LOGI(TAG, "Stored light state - On: %d, R: %d, G: %d, B: %d, W: %d, Brightness: %d",
-            current_light_state.is_on, current_light_state.r, current_light_state.g,
-            current_light_state.b, current_light_state.w, current_light_state.brightness);
-    
-    nvs_close(nvs_handle);
+
+    discovery_hash = hash;
+    if (persist_lock != NULL) {
+        xSemaphoreTake(persist_lock, portMAX_DELAY);
+    }
+    rtc_mirror.discovery_hash = hash;
+    rtc_mirror_seal();
+    if (persist_lock != NULL) {
+        xSemaphoreGive(persist_lock);
+    }
+    ESP_LOGI(TAG, "Stored discovery hash %08" PRIx32, hash);
     return true;
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "lightstate.h"
+#include "ledconfig.h"
 
 // Initialize device configuration
 // Returns true if initialization was successful
@@ -13,13 +14,68 @@ bool device_config_init(void);
 // The returned pointer is valid until the next call to this function
 char* device_config_get_id(void);
 
-// Get the stored light state
+// Get the stored light state of a segment
 // Returns a pointer to the internally stored light state
-light_state_t* device_config_get_light_state(void);
+light_state_t* device_config_get_light_state(int segment);
 
-// Store the current light state to NVS
-// Returns true if storage was successful
-bool device_config_store_light_state(light_state_t* state);
+// Maximum length of a preset name, including the null terminator
+#define LIGHT_PRESET_NAME_LEN 16
+
+// Light state of every segment, recalled together as a scene
+typedef struct {
+    char name[LIGHT_PRESET_NAME_LEN];               // Select option, empty for the default name
+    uint8_t segment_count;                          // Segments saved in the preset, 0 for an empty slot
+    light_state_t states[CONFIG_LED_MAX_SEGMENTS];
+} light_preset_t;
+
+// Flash writes of the light states since boot
+typedef struct {
+    uint32_t requests;      // Calls to device_config_store_light_state()
+    uint32_t commits;       // NVS commits of light states, one per batch of segments
+    uint32_t skipped;       // Writes left out because flash already held the state
+    uint32_t bytes_written; // Flash bytes written, including NVS entry overhead
+} device_config_persist_stats_t;
+
+// Store the current light state of a segment
+// Returns immediately, a background task writes it to NVS once it has been
+// stable for CONFIG_LIGHT_STATE_PERSIST_DELAY_MS
+// Returns true if the segment is valid
+bool device_config_store_light_state(int segment, light_state_t* state);
+
+// Write pending light states to NVS now, for example before a restart
+void device_config_flush(void);
+
+// Get the light state flash write counters
+void device_config_get_persist_stats(device_config_persist_stats_t *out);
+
+// Get the LED hardware configuration loaded at boot
+// Returns a pointer to the internally stored configuration
+led_hw_config_t* device_config_get_led_config(void);
+
+// Get the segment layout loaded at boot
+// Returns a pointer to the internally stored layout
+led_segment_layout_t* device_config_get_segments(void);
+
+// Store a new LED hardware configuration and segment layout to NVS, they are applied at the next boot
+// Returns true if the configuration is valid and was stored
+bool device_config_store_led_config(const led_hw_config_t* config, const led_segment_layout_t* segments);
+
+// Get a preset slot, id from 0 to CONFIG_LIGHT_PRESET_COUNT - 1
+// The presets are read from NVS on the first call and served from RAM after that
+// Returns NULL if id is out of range or the slot is empty
+const light_preset_t* device_config_get_preset(int id);
+
+// Store a preset in a slot, in RAM and NVS
+// Returns true if it was stored
+bool device_config_store_preset(int id, const light_preset_t* preset);
+
+// Get the hash of the last Home Assistant discovery payloads the broker acknowledged
+// Returns 0 if discovery was never published
+uint32_t device_config_get_discovery_hash(void);
+
+// Store the hash of the discovery payloads after the broker acknowledged them
+// Returns true if the hash was stored or already matched
+bool device_config_store_discovery_hash(uint32_t hash);
 
 // Generate a new 6-character device ID
 void device_config_generate_id(void);
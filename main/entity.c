@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "entity.h"
+#include "fnv1a.h"
+
+static const char *TAG = "entity";
+
+// Open addressing table from command topic hash to entity, twice the entities keeps probes short
+#define ENTITY_ROUTE_SLOTS (2 * CONFIG_MQTT_MAX_ENTITIES)
+
+static entity_t entities[CONFIG_MQTT_MAX_ENTITIES];
+static int count = 0;
+static uint8_t routes[ENTITY_ROUTE_SLOTS];    // Entity index + 1, 0 for an empty slot
+
+_Static_assert(CONFIG_MQTT_MAX_ENTITIES < UINT8_MAX, "entity index must fit a route slot");
+
+// In entity_type_t order
+static const char *component_names[ENTITY_TYPE_MAX] = { "light", "switch", "sensor", "number", "select" };
+
+static void add_route(entity_t *entity) {
+    size_t slot = entity->command_hash % ENTITY_ROUTE_SLOTS;
+    while (routes[slot] != 0) {
+        slot = (slot + 1) % ENTITY_ROUTE_SLOTS;
+    }
+    routes[slot] = (uint8_t)(entity->index + 1);
+}
+
+entity_t *entity_register(entity_type_t type, const char *unique_id, const char *name,
+                          const entity_ops_t *ops, void *context) {
+    if (type >= ENTITY_TYPE_MAX || ops == NULL || ops->state == NULL) {
+        return NULL;
+    }
+    if (count == CONFIG_MQTT_MAX_ENTITIES) {
+        ESP_LOGE(TAG, "No room for entity %s, raise MQTT_MAX_ENTITIES", unique_id);
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        if (strcmp(entities[i].unique_id, unique_id) == 0) {
+            ESP_LOGE(TAG, "Entity %s is already registered", unique_id);
+            return NULL;
+        }
+    }
+
+    entity_t *entity = &entities[count];
+    memset(entity, 0, sizeof(entity_t));
+    entity->type = type;
+    entity->index = count;
+    entity->ops = ops;
+    entity->context = context;
+    snprintf(entity->name, sizeof(entity->name), "%s", name);
+    snprintf(entity->unique_id, sizeof(entity->unique_id), "%s", unique_id);
+
+    const char *component = component_names[type];
+    snprintf(entity->config_topic, sizeof(entity->config_topic), ENTITY_TOPIC_PREFIX "%s/%s/config", component, unique_id);
+    snprintf(entity->state_topic, sizeof(entity->state_topic), ENTITY_TOPIC_PREFIX "%s/%s/state", component, unique_id);
+    count++;
+
+    if (ops->command != NULL) {
+        snprintf(entity->command_topic, sizeof(entity->command_topic), ENTITY_TOPIC_PREFIX "%s/%s/set", component, unique_id);
+        const char *suffix = entity->command_topic + strlen(ENTITY_TOPIC_PREFIX);
+        entity->command_hash = fnv1a(FNV1A_INIT, suffix, strlen(suffix));
+        add_route(entity);
+    }
+    return entity;
+}
+
+int entity_count(void) {
+    return count;
+}
+
+entity_t *entity_get(int index) {
+    if (index < 0 || index >= count) {
+        return NULL;
+    }
+    return &entities[index];
+}
+
+entity_t *entity_find_by_command_topic(const char *topic, int len) {
+    const size_t prefix_len = strlen(ENTITY_TOPIC_PREFIX);
+    if (len <= (int)prefix_len || len >= (int)sizeof(entities[0].command_topic) ||
+        memcmp(topic, ENTITY_TOPIC_PREFIX, prefix_len) != 0) {
+        return NULL;
+    }
+
+    uint32_t hash = fnv1a(FNV1A_INIT, topic + prefix_len, len - prefix_len);
+    size_t slot = hash % ENTITY_ROUTE_SLOTS;
+    while (routes[slot] != 0) {
+        entity_t *entity = &entities[routes[slot] - 1];
+        // The hash picks the entity, the compare only rules out a collision
+        if (entity->command_hash == hash && entity->command_topic[len] == '\0' &&
+            memcmp(entity->command_topic, topic, len) == 0) {
+            return entity;
+        }
+        slot = (slot + 1) % ENTITY_ROUTE_SLOTS;
+    }
+    return NULL;
+}
@@ -0,0 +1,65 @@
+#ifndef ENTITY_H
+#define ENTITY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cJSON.h>
+
+// Prefix of every entity topic, the routing hash covers the rest of the topic
+#define ENTITY_TOPIC_PREFIX "homeassistant/"
+
+// Home Assistant platforms an entity can be exposed as
+typedef enum {
+    ENTITY_LIGHT = 0,
+    ENTITY_SWITCH,
+    ENTITY_SENSOR,
+    ENTITY_NUMBER,
+    ENTITY_SELECT,
+    ENTITY_TYPE_MAX
+} entity_type_t;
+
+typedef struct entity entity_t;
+
+// What an entity implements, the registry handles topics and routing
+typedef struct {
+    // Add the platform specific fields to the discovery config
+    // name, unique_id, the topics and the device are already set
+    void (*discovery)(const entity_t *entity, cJSON *config);
+    // Apply a command payload, NULL for read only entities
+    // Returns true if the state changed and should be published
+    bool (*command)(const entity_t *entity, const char *payload, int len);
+    // Write the state payload, called from the MQTT task and the publish timer task
+    // Returns the length, or 0 if it does not fit in size
+    size_t (*state)(const entity_t *entity, char *buf, size_t size);
+} entity_ops_t;
+
+struct entity {
+    entity_type_t type;
+    int index;                  // Position in the registry
+    const entity_ops_t *ops;
+    void *context;              // Passed on through the entity, e.g. a segment index
+    char name[32];
+    char unique_id[32];
+    char config_topic[64];
+    char command_topic[64];     // Empty for read only entities
+    char state_topic[64];
+    uint32_t command_hash;      // Hash of the command topic after ENTITY_TOPIC_PREFIX
+};
+
+// Register an entity, its topics are derived from the type and unique_id
+// Returns the entity, or NULL if the registry is full or the unique_id is in use
+entity_t *entity_register(entity_type_t type, const char *unique_id, const char *name,
+                          const entity_ops_t *ops, void *context);
+
+// Number of registered entities
+int entity_count(void);
+
+// Get a registered entity by index
+entity_t *entity_get(int index);
+
+// Find the entity whose command topic is topic, topic does not need to be null terminated
+// Returns NULL if no entity listens on topic
+entity_t *entity_find_by_command_topic(const char *topic, int len);
+
+#endif // ENTITY_H
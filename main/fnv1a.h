@@ -0,0 +1,22 @@
+#ifndef FNV1A_H
+#define FNV1A_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Offset basis of the 32-bit FNV-1a hash, the hash of no data
+#define FNV1A_INIT 2166136261u
+
+// 32-bit FNV-1a hash of len bytes, continued from hash
+// Start with FNV1A_INIT, pass the result back in to hash several pieces as one
+static inline uint32_t fnv1a(uint32_t hash, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+#endif // FNV1A_H
@@ -0,0 +1,36 @@
+#!/usr/bin/env python
+#
+# Generates the gamma lookup table used by the LED color pipeline.
+#
+# The table maps a 12-bit (0-4095) perceptual channel value, already scaled by
+# brightness, to an 8.8 fixed-point output level. The upper byte is the value
+# sent to the LED, the lower byte is the fraction used for temporal dithering.
+
+import argparse
+
+LUT_SIZE = 4096
+MAX_LEVEL = 255 << 8
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate the 12-bit gamma lookup table')
+    parser.add_argument('--gamma', type=float, default=2.2, help='gamma exponent')
+    parser.add_argument('--output', required=True, help='generated C source')
+    args = parser.parse_args()
+
+    values = []
+    for i in range(LUT_SIZE):
+        level = round(((i / (LUT_SIZE - 1)) ** args.gamma) * MAX_LEVEL)
+        values.append(min(level, MAX_LEVEL))
+
+    with open(args.output, 'w') as f:
+        f.write('// Generated by gen_gamma_lut.py (gamma {}), do not edit\n\n'.format(args.gamma))
+        f.write('#include "led_color.h"\n\n')
+        f.write('const uint16_t gamma_lut[GAMMA_LUT_SIZE] = {\n')
+        for row in range(0, LUT_SIZE, 16):
+            f.write('    ' + ', '.join('0x{:04x}'.format(v) for v in values[row:row + 16]) + ',\n')
+        f.write('};\n')
+
+
+if __name__ == '__main__':
+    main()
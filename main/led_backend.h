@@ -0,0 +1,27 @@
+#ifndef LED_BACKEND_H
+#define LED_BACKEND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ledconfig.h"
+#include "led_driver.h"
+
+// Output stage behind led_driver.c
+// led_backend_rmt.c drives a real strip, led_backend_sim.c records frames on the linux target
+
+// Prepare the output for frames of frame_size bytes in the given layout
+// Returns true if initialization was successful
+bool led_backend_init(const led_hw_config_t *config, const led_pixel_layout_t *layout, size_t frame_size);
+
+// Release everything allocated by led_backend_init()
+void led_backend_deinit(void);
+
+// Start sending a frame, it must not be modified until led_backend_wait() returns
+// Returns true if the transmission was started
+bool led_backend_transmit(const uint8_t *frame, size_t size);
+
+// Wait until the last transmitted frame has been sent
+void led_backend_wait(void);
+
+#endif // LED_BACKEND_H
@@ -0,0 +1,207 @@
+#include "led_backend.h"
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "driver/rmt_tx.h"
+
+// 10 MHz RMT clock, one tick is 0.1 us
+#define RMT_RESOLUTION_HZ 10000000
+#define RMT_TICKS_PER_US (RMT_RESOLUTION_HZ / 1000000)
+
+static const char *TAG = "led_rmt";
+
+// Bit timing of a chip, in RMT ticks
+typedef struct {
+    uint8_t t0h;
+    uint8_t t0l;
+    uint8_t t1h;
+    uint8_t t1l;
+    uint16_t reset_us;  // Low time that latches a frame
+} led_timing_t;
+
+static const led_timing_t chip_timings[LED_CHIP_MAX] = {
+    // Newer WS2812B revisions need at least 280 us low to latch a frame
+    [LED_CHIP_WS2812B] = { .t0h = 3, .t0l = 9, .t1h = 9, .t1l = 3, .reset_us = 280 },
+    [LED_CHIP_SK6812]  = { .t0h = 3, .t0l = 9, .t1h = 6, .t1l = 6, .reset_us = 80 },
+    [LED_CHIP_SK6812_RGBW] = { .t0h = 3, .t0l = 9, .t1h = 6, .t1l = 6, .reset_us = 80 },
+};
+
+// Encoder that sends the pixel bytes followed by the reset (latch) code
+typedef struct {
+    rmt_encoder_t base;
+    rmt_encoder_t *bytes_encoder;
+    rmt_encoder_t *copy_encoder;
+    int state;
+    rmt_symbol_word_t reset_code;
+} led_strip_encoder_t;
+
+static rmt_channel_handle_t led_channel = NULL;
+static rmt_encoder_handle_t led_encoder = NULL;
+
+static size_t led_strip_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel,
+                               const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    led_strip_encoder_t *led = __containerof(encoder, led_strip_encoder_t, base);
+    rmt_encode_state_t session_state = RMT_ENCODING_RESET;
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    size_t encoded_symbols = 0;
+
+    switch (led->state) {
+    case 0: // pixel data
+        encoded_symbols += led->bytes_encoder->encode(led->bytes_encoder, channel, primary_data, data_size, &session_state);
+        if (session_state & RMT_ENCODING_COMPLETE) {
+            led->state = 1;
+        }
+        if (session_state & RMT_ENCODING_MEM_FULL) {
+            state |= RMT_ENCODING_MEM_FULL;
+            goto out; // yield until the RMT memory has room again
+        }
+    // fall-through
+    case 1: // reset code
+        encoded_symbols += led->copy_encoder->encode(led->copy_encoder, channel, &led->reset_code,
+                                                     sizeof(led->reset_code), &session_state);
+        if (session_state & RMT_ENCODING_COMPLETE) {
+            led->state = RMT_ENCODING_RESET;
+            state |= RMT_ENCODING_COMPLETE;
+        }
+        if (session_state & RMT_ENCODING_MEM_FULL) {
+            state |= RMT_ENCODING_MEM_FULL;
+            goto out;
+        }
+    }
+out:
+    *ret_state = state;
+    return encoded_symbols;
+}
+
+static esp_err_t led_strip_encoder_del(rmt_encoder_t *encoder)
+{
+    led_strip_encoder_t *led = __containerof(encoder, led_strip_encoder_t, base);
+    rmt_del_encoder(led->bytes_encoder);
+    rmt_del_encoder(led->copy_encoder);
+    free(led);
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_encoder_reset(rmt_encoder_t *encoder)
+{
+    led_strip_encoder_t *led = __containerof(encoder, led_strip_encoder_t, base);
+    rmt_encoder_reset(led->bytes_encoder);
+    rmt_encoder_reset(led->copy_encoder);
+    led->state = RMT_ENCODING_RESET;
+    return ESP_OK;
+}
+
+static esp_err_t new_led_strip_encoder(const led_timing_t *timing, rmt_encoder_handle_t *ret_encoder)
+{
+    esp_err_t ret = ESP_OK;
+    led_strip_encoder_t *led = calloc(1, sizeof(led_strip_encoder_t));
+    ESP_RETURN_ON_FALSE(led, ESP_ERR_NO_MEM, TAG, "no memory for the strip encoder");
+    led->base.encode = led_strip_encode;
+    led->base.del = led_strip_encoder_del;
+    led->base.reset = led_strip_encoder_reset;
+
+    rmt_bytes_encoder_config_t bytes_encoder_config = {
+        .bit0 = {
+            .level0 = 1,
+            .duration0 = timing->t0h,
+            .level1 = 0,
+            .duration1 = timing->t0l,
+        },
+        .bit1 = {
+            .level0 = 1,
+            .duration0 = timing->t1h,
+            .level1 = 0,
+            .duration1 = timing->t1l,
+        },
+        .flags.msb_first = 1,
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &led->bytes_encoder), err, TAG, "create bytes encoder failed");
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &led->copy_encoder), err, TAG, "create copy encoder failed");
+
+    uint32_t reset_ticks = RMT_TICKS_PER_US * timing->reset_us / 2;
+    led->reset_code = (rmt_symbol_word_t) {
+        .level0 = 0,
+        .duration0 = reset_ticks,
+        .level1 = 0,
+        .duration1 = reset_ticks,
+    };
+    *ret_encoder = &led->base;
+    return ESP_OK;
+
+err:
+    if (led->bytes_encoder) {
+        rmt_del_encoder(led->bytes_encoder);
+    }
+    if (led->copy_encoder) {
+        rmt_del_encoder(led->copy_encoder);
+    }
+    free(led);
+    return ret;
+}
+
+bool led_backend_init(const led_hw_config_t *config, const led_pixel_layout_t *layout, size_t frame_size) {
+    rmt_tx_channel_config_t tx_channel_config = {
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .gpio_num = config->gpio,
+        .mem_block_symbols = 64,    // a larger block means fewer refill interrupts
+        .resolution_hz = RMT_RESOLUTION_HZ,
+        .trans_queue_depth = 2,
+    };
+    esp_err_t err = rmt_new_tx_channel(&tx_channel_config, &led_channel);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error creating RMT channel: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    err = new_led_strip_encoder(&chip_timings[config->chip], &led_encoder);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error creating strip encoder: %s", esp_err_to_name(err));
+        led_backend_deinit();
+        return false;
+    }
+
+    err = rmt_enable(led_channel);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error enabling RMT channel: %s", esp_err_to_name(err));
+        led_backend_deinit();
+        return false;
+    }
+    return true;
+}
+
+void led_backend_deinit(void) {
+    if (led_channel != NULL) {
+        rmt_disable(led_channel);
+        rmt_del_channel(led_channel);
+        led_channel = NULL;
+    }
+    if (led_encoder != NULL) {
+        rmt_del_encoder(led_encoder);
+        led_encoder = NULL;
+    }
+}
+
+bool led_backend_transmit(const uint8_t *frame, size_t size) {
+    if (led_channel == NULL) {
+        return false;
+    }
+
+    rmt_transmit_config_t tx_config = {
+        .loop_count = 0,
+    };
+    esp_err_t err = rmt_transmit(led_channel, led_encoder, frame, size, &tx_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error starting transmission: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+void led_backend_wait(void) {
+    if (led_channel != NULL) {
+        rmt_tx_wait_all_done(led_channel, portMAX_DELAY);
+    }
+}
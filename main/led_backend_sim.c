@@ -0,0 +1,111 @@
+#include "led_backend.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "led_sim.h"
+
+static const char *TAG = "led_sim";
+
+static led_pixel_layout_t sim_layout;
+static uint16_t sim_led_count = 0;
+static size_t sim_frame_size = 0;
+static uint8_t *recorded_frames = NULL;     // Ring of CONFIG_LED_SIM_RECORD_FRAMES frames
+static int64_t recorded_times[CONFIG_LED_SIM_RECORD_FRAMES];
+static uint32_t frame_count = 0;
+static FILE *dump_file = NULL;
+static uint8_t *dump_row = NULL;
+
+// Append the frame to the dump file as a binary PPM image, one pixel row per frame
+// Consecutive images in one file are valid netpbm, the timestamp is a header comment
+static void dump_frame(const uint8_t *frame, int64_t timestamp_us)
+{
+    const uint8_t *pixel = frame;
+    for (int i = 0; i < sim_led_count; i++) {
+        dump_row[i * 3 + 0] = pixel[sim_layout.r];
+        dump_row[i * 3 + 1] = pixel[sim_layout.g];
+        dump_row[i * 3 + 2] = pixel[sim_layout.b];
+        pixel += sim_layout.bytes_per_pixel;
+    }
+    fprintf(dump_file, "P6\n# frame %" PRIu32 " t=%lld us\n%d 1\n255\n",
+            frame_count, (long long)timestamp_us, sim_led_count);
+    fwrite(dump_row, 3, sim_led_count, dump_file);
+}
+
+bool led_backend_init(const led_hw_config_t *config, const led_pixel_layout_t *layout, size_t frame_size) {
+    sim_layout = *layout;
+    sim_led_count = config->led_count;
+    sim_frame_size = frame_size;
+    frame_count = 0;
+
+    recorded_frames = calloc(CONFIG_LED_SIM_RECORD_FRAMES, frame_size);
+    if (recorded_frames == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %d recorded frames", CONFIG_LED_SIM_RECORD_FRAMES);
+        return false;
+    }
+
+    const char *dump_path = CONFIG_LED_SIM_DUMP_PATH;
+    if (dump_path[0] != '\0') {
+        dump_file = fopen(dump_path, "wb");
+        dump_row = malloc((size_t)sim_led_count * 3);
+        if (dump_file == NULL || dump_row == NULL) {
+            ESP_LOGE(TAG, "Cannot dump frames to %s", dump_path);
+            led_backend_deinit();
+            return false;
+        }
+        ESP_LOGI(TAG, "Dumping frames to %s", dump_path);
+    }
+    return true;
+}
+
+void led_backend_deinit(void) {
+    if (dump_file != NULL) {
+        fclose(dump_file);
+        dump_file = NULL;
+    }
+    free(dump_row);
+    dump_row = NULL;
+    free(recorded_frames);
+    recorded_frames = NULL;
+}
+
+bool led_backend_transmit(const uint8_t *frame, size_t size) {
+    if (recorded_frames == NULL || size != sim_frame_size) {
+        return false;
+    }
+
+    // The frame is "sent" immediately, led_backend_wait() never blocks
+    int64_t now = esp_timer_get_time();
+    uint32_t slot = frame_count % CONFIG_LED_SIM_RECORD_FRAMES;
+    memcpy(recorded_frames + slot * sim_frame_size, frame, size);
+    recorded_times[slot] = now;
+    if (dump_file != NULL) {
+        dump_frame(frame, now);
+    }
+    frame_count++;
+    return true;
+}
+
+void led_backend_wait(void) {
+}
+
+uint32_t led_sim_frame_count(void) {
+    return frame_count;
+}
+
+bool led_sim_get_frame(uint32_t age, led_sim_frame_t *out) {
+    if (recorded_frames == NULL || age >= frame_count || age >= CONFIG_LED_SIM_RECORD_FRAMES) {
+        return false;
+    }
+
+    uint32_t sequence = frame_count - 1 - age;
+    uint32_t slot = sequence % CONFIG_LED_SIM_RECORD_FRAMES;
+    out->sequence = sequence;
+    out->timestamp_us = recorded_times[slot];
+    out->data = recorded_frames + slot * sim_frame_size;
+    out->size = sim_frame_size;
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef LED_COLOR_H
+#define LED_COLOR_H
+
+#include <stdint.h>
+
+// Number of entries in the gamma table, one per 12-bit input value
+#define GAMMA_LUT_SIZE 4096
+#define COLOR_MAX (GAMMA_LUT_SIZE - 1)
+
+// Highest 8.8 fixed-point output level
+#define LEVEL_MAX 0xFF00
+
+// 12-bit perceptual value -> 8.8 fixed-point linear output level
+// Generated at build time by gen_gamma_lut.py
+extern const uint16_t gamma_lut[GAMMA_LUT_SIZE];
+
+// Scale a 12-bit channel value by a 12-bit brightness and gamma correct it
+// Returns an 8.8 fixed-point level, the low byte is the dithering fraction
+static inline uint16_t led_color_level(uint16_t value, uint16_t brightness)
+{
+    if (value > COLOR_MAX) value = COLOR_MAX;
+    if (brightness > COLOR_MAX) brightness = COLOR_MAX;
+    return gamma_lut[((uint32_t)value * (brightness + 1)) >> 12];
+}
+
+// Move the part shared by all three color levels into the white level
+// Integer only: min(r, g, b) is subtracted from the colors and added to w
+static inline void led_color_extract_white(uint16_t *r, uint16_t *g, uint16_t *b, uint16_t *w)
+{
+    uint16_t white = *r < *g ? *r : *g;
+    if (*b < white) white = *b;
+    *r -= white;
+    *g -= white;
+    *b -= white;
+    uint32_t sum = (uint32_t)*w + white;
+    *w = sum > LEVEL_MAX ? LEVEL_MAX : (uint16_t)sum;
+}
+
+// Mix a white level into the color levels, for strips without a white channel
+static inline void led_color_fold_white(uint16_t *r, uint16_t *g, uint16_t *b, uint16_t w)
+{
+    uint32_t r_sum = (uint32_t)*r + w, g_sum = (uint32_t)*g + w, b_sum = (uint32_t)*b + w;
+    *r = r_sum > LEVEL_MAX ? LEVEL_MAX : (uint16_t)r_sum;
+    *g = g_sum > LEVEL_MAX ? LEVEL_MAX : (uint16_t)g_sum;
+    *b = b_sum > LEVEL_MAX ? LEVEL_MAX : (uint16_t)b_sum;
+}
+
+// Resolve an 8.8 level to the 8-bit LED value using a dither offset (0-255)
+// The maximum level is 0xFF00, so the sum never overflows
+static inline uint8_t led_color_dither(uint16_t level, uint8_t dither)
+{
+    return (uint8_t)((uint16_t)(level + dither) >> 8);
+}
+
+// Dither offset for a frame: bit-reversed frame counter, so that any run of
+// consecutive frames spreads the offsets evenly over 0-255
+static inline uint8_t led_color_frame_dither(uint8_t frame)
+{
+    frame = (uint8_t)((frame & 0xF0) >> 4 | (frame & 0x0F) << 4);
+    frame = (uint8_t)((frame & 0xCC) >> 2 | (frame & 0x33) << 2);
+    frame = (uint8_t)((frame & 0xAA) >> 1 | (frame & 0x55) << 1);
+    return frame;
+}
+
+#endif // LED_COLOR_H
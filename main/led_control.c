@@ -0,0 +1,353 @@
+#include "led_control.h"
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "led_color.h"
+#include "led_driver.h"
+#include "led_effects.h"
+#include "led_render.h"
+#include "mqtt.h"
+#include "device_config.h"
+#include "boot_timing.h"
+
+// How often the frame timing is logged, at most
+#define STATS_LOG_INTERVAL_MS 10000
+
+// Number of frame buffers a changed segment has to be written into
+#define FRAME_BUFFER_COUNT 2
+
+static const char *TAG = "LED";
+
+// Render state of one segment
+typedef struct {
+    uint16_t start;                  // Dirty range of the segment on the strip
+    uint16_t count;
+    light_state_t target_state;      // Last state received from MQTT
+    uint32_t state_version;          // Version of the MQTT state target_state was read from
+    light_state_t from_state;        // Output when the running transition started
+    bool has_target;
+    uint32_t transition_start_ms;
+    uint32_t transition_ms;
+    uint8_t stale_buffers;           // Frame buffers still holding an outdated copy
+    bool animating;                  // Effect, transition or dithering running
+} segment_render_t;
+
+static segment_render_t segments[CONFIG_LED_MAX_SEGMENTS];
+static int segment_count = 0;
+static int led_count = 0;
+static led_rgb_t* effect_pixels;
+static uint8_t* effect_scratch;
+static TaskHandle_t led_task_handle = NULL;
+
+// Held while a frame is rendered, realtime streaming takes it to write the back buffer
+static SemaphoreHandle_t frame_lock = NULL;
+static volatile bool realtime_active = false;
+static volatile bool realtime_stopped = false;
+static uint8_t stale_gaps = 0;      // Frame buffers whose LEDs outside the segments still show a stream
+
+static led_frame_stats_t stats;
+static uint8_t frame_counter = 0;
+
+static inline uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void configure_led(void)
+{
+    // The strip is sized once at boot, frames never allocate
+    const led_hw_config_t *config = device_config_get_led_config();
+    if (!led_driver_init(config)) {
+        ESP_LOGE(TAG, "Failed to initialise LED strip");
+        return;
+    }
+    led_count = config->led_count;
+    ESP_LOGI(TAG, "Initialised LED strip");
+
+    const led_segment_layout_t *layout = device_config_get_segments();
+    for (int i = 0; i < layout->count; i++) {
+        segments[i].start = layout->segments[i].start;
+        segments[i].count = layout->segments[i].count;
+    }
+    segment_count = layout->count;
+
+    effect_pixels = calloc(led_count, sizeof(led_rgb_t));
+    effect_scratch = calloc(led_count, sizeof(uint8_t));
+    if (effect_pixels == NULL || effect_scratch == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate effect buffers, effects disabled");
+        free(effect_pixels);
+        free(effect_scratch);
+        effect_pixels = NULL;
+        effect_scratch = NULL;
+    }
+}
+
+// Linear interpolation of a 12-bit value, t is a 0.16 fixed-point fraction
+static inline uint16_t lerp12(uint16_t a, uint16_t b, uint32_t t)
+{
+    return (uint16_t)(a + ((((int32_t)b - (int32_t)a) * (int32_t)t) >> 16));
+}
+
+// Output state part way through a transition
+// An "off" state fades through brightness 0 and keeps the color of the other side
+static void interpolate_state(const light_state_t *from, const light_state_t *to, uint32_t t, light_state_t *out)
+{
+    const light_state_t *color_from = from->is_on ? from : to;
+
+    *out = *to;
+    out->is_on = true;
+    out->r = lerp12(color_from->r, to->r, t);
+    out->g = lerp12(color_from->g, to->g, t);
+    out->b = lerp12(color_from->b, to->b, t);
+    out->w = lerp12(color_from->w, to->w, t);
+    out->brightness = lerp12(from->is_on ? from->brightness : 0, to->is_on ? to->brightness : 0, t);
+}
+
+// State of a segment to show at time now, advancing its running transition
+static void current_output(segment_render_t *seg, uint32_t now, light_state_t *out)
+{
+    if (seg->transition_ms == 0) {
+        *out = seg->target_state;
+        return;
+    }
+
+    uint32_t elapsed = now - seg->transition_start_ms;
+    if (elapsed >= seg->transition_ms) {
+        seg->transition_ms = 0;
+        *out = seg->target_state;
+        return;
+    }
+    interpolate_state(&seg->from_state, &seg->target_state,
+                      (uint32_t)(((uint64_t)elapsed << 16) / seg->transition_ms), out);
+}
+
+// Pick up a new target state of a segment, starting a transition from the current output
+// Returns true if the state changed
+static bool update_target(int index, uint32_t now)
+{
+    segment_render_t *seg = &segments[index];
+    if (seg->has_target && mqtt_get_light_state_version(index) == seg->state_version) {
+        return false;
+    }
+
+    // A consistent copy, the MQTT task may publish the next state meanwhile
+    light_state_t state;
+    uint32_t fade_ms;
+    seg->state_version = mqtt_read_light_target(index, &state, &fade_ms);
+    if (seg->has_target && memcmp(&state, &seg->target_state, sizeof(light_state_t)) == 0) {
+        return false;
+    }
+
+    if (seg->has_target && fade_ms > 0) {
+        current_output(seg, now, &seg->from_state);
+        seg->transition_start_ms = now;
+        seg->transition_ms = fade_ms;
+    } else {
+        seg->transition_ms = 0;
+    }
+    memcpy(&seg->target_state, &state, sizeof(light_state_t));
+    seg->has_target = true;
+    return true;
+}
+
+// Renders the pixels of one segment into the frame
+// Returns true if the segment has fractional levels that need temporal dithering
+static bool render_segment(const segment_render_t *seg, const light_state_t *stLightState,
+                           uint8_t *frame, uint8_t frame_dither, uint32_t now)
+{
+    led_render_result_t result = led_render_pixels(frame, led_driver_layout(), seg->start, seg->count, stLightState,
+                                                   effect_pixels, effect_scratch, frame_dither, now);
+    if (result.over_budget) {
+        stats.budget_overruns++;
+    }
+    stats.pixels_rendered += seg->count;
+    return result.dithering;
+}
+
+// Renders every dirty segment into the back buffer and sends the frame
+static void set_led(uint32_t now)
+{
+    uint8_t *frame = led_driver_back_buffer();
+    if (frame == NULL) {
+        return;
+    }
+    uint8_t frame_dither = led_color_frame_dither(frame_counter++);
+
+    // Segments need not cover the whole strip, the LEDs between them are turned off
+    if (stale_gaps > 0) {
+        memset(frame, 0, (size_t)led_count * led_driver_layout()->bytes_per_pixel);
+        stale_gaps--;
+    }
+
+    for (int i = 0; i < segment_count; i++) {
+        segment_render_t *seg = &segments[i];
+        if (seg->stale_buffers == 0) {
+            continue;   // This buffer already holds the current pixels of the segment
+        }
+
+        light_state_t output;
+        current_output(seg, now, &output);
+        bool dithering = render_segment(seg, &output, frame, frame_dither, now);
+
+        seg->animating = seg->transition_ms > 0 || dithering ||
+                         (output.is_on && output.effect != LED_EFFECT_SOLID);
+        seg->stale_buffers = seg->animating ? FRAME_BUFFER_COUNT : seg->stale_buffers - 1;
+    }
+
+    // Sent in the background while the next frame is rendered
+    led_driver_present();
+}
+
+static void update_stats(uint32_t frame_us)
+{
+    if (stats.frames == 0) {
+        // esp_timer starts with the boot, so this is the time the strip stayed dark
+        stats.first_frame_us = (uint32_t)esp_timer_get_time();
+        boot_timing_mark(BOOT_FIRST_FRAME);
+        ESP_LOGI(TAG, "First frame sent %" PRIu32 " ms after boot", stats.first_frame_us / 1000);
+    }
+    stats.frames++;
+    stats.last_frame_us = frame_us;
+    if (frame_us > stats.max_frame_us) {
+        stats.max_frame_us = frame_us;
+    }
+    // Exponential moving average over roughly 16 frames
+    stats.avg_frame_us = stats.avg_frame_us == 0 ? frame_us : stats.avg_frame_us - (stats.avg_frame_us >> 4) + (frame_us >> 4);
+}
+
+void led_control(void *pvParameters) {
+    led_task_handle = xTaskGetCurrentTaskHandle();
+    frame_lock = xSemaphoreCreateMutex();
+
+    /* Configure the peripheral according to the LED type */
+    configure_led();
+
+    TickType_t frame_period = pdMS_TO_TICKS(1000 / CONFIG_LED_FPS);
+    if (frame_period == 0) frame_period = 1;
+    TickType_t last_wake = xTaskGetTickCount();
+    uint32_t last_stats_log = now_ms();
+    bool animating = false;
+
+    while (1) {
+        uint32_t now = now_ms();
+
+        // A changed segment has to be written into both frame buffers, an
+        // unchanged one is only redrawn when the buffer holding it is stale
+        bool changed = false;
+        for (int i = 0; i < segment_count; i++) {
+            if (update_target(i, now)) {
+                segments[i].stale_buffers = FRAME_BUFFER_COUNT;
+                changed = true;
+            }
+        }
+
+        // Both buffers were overwritten by the stream, clear them and redraw every segment
+        if (realtime_stopped) {
+            realtime_stopped = false;
+            stale_gaps = FRAME_BUFFER_COUNT;
+            for (int i = 0; i < segment_count; i++) {
+                segments[i].stale_buffers = FRAME_BUFFER_COUNT;
+            }
+            changed = true;
+        }
+
+        // A realtime stream owns the strip, the state is picked up again once it stops
+        if (realtime_active) {
+            animating = false;
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            last_wake = xTaskGetTickCount();
+            continue;
+        }
+
+        if (changed || animating) {
+            xSemaphoreTake(frame_lock, portMAX_DELAY);
+            if (!realtime_active) {
+                int64_t start = esp_timer_get_time();
+                set_led(now);
+                update_stats((uint32_t)(esp_timer_get_time() - start));
+            }
+            xSemaphoreGive(frame_lock);
+        } else {
+            stats.skipped++;
+            ESP_LOGD(TAG, "State unchanged, skipped frame (%" PRIu32 " total)", stats.skipped);
+        }
+
+        animating = false;
+        for (int i = 0; i < segment_count; i++) {
+            animating |= segments[i].animating;
+        }
+
+        // Also logged on the wakeups of a static strip, which is where frames are skipped
+        if (now - last_stats_log >= STATS_LOG_INTERVAL_MS) {
+            last_stats_log = now;
+            ESP_LOGI(TAG, "%" PRIu32 " frames, %" PRIu32 " skipped, avg %" PRIu32 " us, max %" PRIu32 " us, %" PRIu32 " late, %" PRIu32 " over budget",
+                     stats.frames, stats.skipped, stats.avg_frame_us, stats.max_frame_us, stats.late, stats.budget_overruns);
+        }
+
+        if (animating) {
+            // Fixed frame rate, drift compensated against the previous wake time
+            if (xTaskDelayUntil(&last_wake, frame_period) == pdFALSE) {
+                stats.late++;
+            }
+            ulTaskNotifyTake(pdTRUE, 0);
+        } else {
+            // Sleep until the MQTT layer reports a state change
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            last_wake = xTaskGetTickCount();
+        }
+    }
+}
+
+void led_control_notify(void) {
+    if (led_task_handle != NULL) {
+        xTaskNotifyGive(led_task_handle);
+    }
+}
+
+void led_control_get_stats(led_frame_stats_t *out) {
+    *out = stats;
+}
+
+int led_control_get_led_count(void) {
+    return led_count;
+}
+
+uint8_t* led_control_realtime_begin(void) {
+    if (frame_lock == NULL) {
+        return NULL;
+    }
+
+    xSemaphoreTake(frame_lock, portMAX_DELAY);
+    uint8_t *frame = led_driver_back_buffer();
+    if (frame == NULL) {
+        // No stream owns the strip then, the LED task keeps rendering the light state
+        xSemaphoreGive(frame_lock);
+        return NULL;
+    }
+    realtime_active = true;
+    return frame;
+}
+
+void led_control_realtime_end(bool present) {
+    if (present) {
+        led_driver_present();
+        stats.frames++;
+    }
+    xSemaphoreGive(frame_lock);
+}
+
+void led_control_realtime_stop(void) {
+    if (!realtime_active) {
+        return;
+    }
+    realtime_active = false;
+    realtime_stopped = true;
+    if (led_task_handle != NULL) {
+        xTaskNotifyGive(led_task_handle);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef LED_CONTROL_H
+#define LED_CONTROL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Frame timing counters of the LED task
+typedef struct {
+    uint32_t frames;          // Frames pushed to the strip
+    uint32_t skipped;         // Wakeups that did not need a new frame
+    uint32_t late;            // Animated frames that missed their slot at CONFIG_LED_FPS
+    uint32_t budget_overruns; // Effect renders that exceeded the effect CPU budget
+    uint32_t pixels_rendered; // Pixels recomputed, only dirty segments are redrawn
+    uint32_t last_frame_us;   // Render time of the last frame, including any wait for the previous one
+    uint32_t max_frame_us;    // Worst frame time seen
+    uint32_t avg_frame_us;    // Moving average of the frame time
+    uint32_t first_frame_us;  // Time from boot until the first frame was sent, 0 before it
+} led_frame_stats_t;
+
+// FreeRTOS task that renders the light state to the LED strip
+// Blocks until led_control_notify() is called, and only runs at a fixed frame
+// rate while an effect, transition or dithering is active
+void led_control(void *pvParameters);
+
+// Wake the LED task because the light state of a segment has changed
+// The fade into the new state is read from the published snapshot
+// Safe to call before the LED task is running
+void led_control_notify(void);
+
+// Get a copy of the frame timing counters
+void led_control_get_stats(led_frame_stats_t *stats);
+
+// Number of LEDs on the strip, 0 before the LED task has started
+int led_control_get_led_count(void);
+
+// Take over the strip for realtime streaming and lock the back buffer
+// Returns the buffer to write wire-order pixels into, or NULL if the strip is not ready
+// Every non-NULL return must be followed by led_control_realtime_end()
+uint8_t* led_control_realtime_begin(void);
+
+// Unlock the back buffer, sending it to the strip if present is true
+void led_control_realtime_end(bool present);
+
+// Hand the strip back to the light state once a stream has stopped
+void led_control_realtime_stop(void);
+
+#endif // LED_CONTROL_H
@@ -0,0 +1,104 @@
+#include "led_driver.h"
+#include <stdlib.h>
+#include "esp_log.h"
+
+#include "led_backend.h"
+
+static const char *TAG = "led_driver";
+
+// Byte offsets of r, g and b for each led_color_order_t
+static const uint8_t color_offsets[LED_ORDER_MAX][3] = {
+    [LED_ORDER_GRB] = {1, 0, 2},
+    [LED_ORDER_RGB] = {0, 1, 2},
+    [LED_ORDER_BRG] = {1, 2, 0},
+    [LED_ORDER_RBG] = {0, 2, 1},
+    [LED_ORDER_GBR] = {2, 0, 1},
+    [LED_ORDER_BGR] = {2, 1, 0},
+};
+
+static led_pixel_layout_t layout;
+static uint8_t *frame_buffers[2];
+static int back_index = 0;
+static size_t frame_size = 0;
+static bool frame_in_flight = false;
+static bool initialized = false;
+
+bool led_driver_init(const led_hw_config_t *config) {
+    if (config->chip >= LED_CHIP_MAX || config->color_order >= LED_ORDER_MAX) {
+        ESP_LOGE(TAG, "Unsupported chip %d or color order %d", config->chip, config->color_order);
+        return false;
+    }
+
+    // RGBW chips send the white byte after the three color bytes
+    bool rgbw = config->chip == LED_CHIP_SK6812_RGBW;
+    layout.bytes_per_pixel = rgbw ? 4 : 3;
+    layout.r = color_offsets[config->color_order][0];
+    layout.g = color_offsets[config->color_order][1];
+    layout.b = color_offsets[config->color_order][2];
+    layout.w = rgbw ? 3 : 0;
+
+    // Front and back buffer share a single allocation
+    frame_size = (size_t)config->led_count * layout.bytes_per_pixel;
+    frame_buffers[0] = calloc(2, frame_size);
+    if (frame_buffers[0] == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate frame buffers for %d LEDs", config->led_count);
+        return false;
+    }
+    frame_buffers[1] = frame_buffers[0] + frame_size;
+    back_index = 0;
+    frame_in_flight = false;
+
+    if (!led_backend_init(config, &layout, frame_size)) {
+        free(frame_buffers[0]);
+        frame_buffers[0] = NULL;
+        frame_buffers[1] = NULL;
+        return false;
+    }
+    initialized = true;
+
+    ESP_LOGI(TAG, "Strip of %d LEDs on GPIO %d, %u bytes per frame buffer",
+             config->led_count, config->gpio, (unsigned)frame_size);
+    return true;
+}
+
+void led_driver_deinit(void) {
+    if (!initialized) {
+        return;
+    }
+    if (frame_in_flight) {
+        led_backend_wait();
+        frame_in_flight = false;
+    }
+    led_backend_deinit();
+    free(frame_buffers[0]);
+    frame_buffers[0] = NULL;
+    frame_buffers[1] = NULL;
+    initialized = false;
+}
+
+const led_pixel_layout_t* led_driver_layout(void) {
+    return &layout;
+}
+
+uint8_t* led_driver_back_buffer(void) {
+    return frame_buffers[back_index];
+}
+
+bool led_driver_present(void) {
+    if (!initialized) {
+        return false;
+    }
+
+    // The other buffer may still be on the wire, it becomes the next back buffer
+    if (frame_in_flight) {
+        led_backend_wait();
+        frame_in_flight = false;
+    }
+
+    if (!led_backend_transmit(frame_buffers[back_index], frame_size)) {
+        return false;
+    }
+    frame_in_flight = true;
+    back_index ^= 1;
+    return true;
+}
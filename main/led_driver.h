@@ -0,0 +1,60 @@
+#ifndef LED_DRIVER_H
+#define LED_DRIVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ledconfig.h"
+
+// Layout of one pixel in the frame buffer, which is stored in wire order
+typedef struct {
+    uint8_t bytes_per_pixel;
+    uint8_t r;  // Byte offset of the red channel inside a pixel
+    uint8_t g;  // Byte offset of the green channel inside a pixel
+    uint8_t b;  // Byte offset of the blue channel inside a pixel
+    uint8_t w;  // Byte offset of the white channel, only valid for 4 bytes per pixel
+} led_pixel_layout_t;
+
+// Check whether the strip has a separate white channel
+static inline bool led_driver_has_white(const led_pixel_layout_t *layout)
+{
+    return layout->bytes_per_pixel == 4;
+}
+
+// Initialize the strip output and allocate the front and back frame buffers
+// This is the only allocation, frames are rendered without touching the heap
+// Returns true if initialization was successful
+bool led_driver_init(const led_hw_config_t *config);
+
+// Wait for the last frame and free the frame buffers, led_driver_init() may be called again
+void led_driver_deinit(void);
+
+// Pixel layout of the frame buffers
+const led_pixel_layout_t* led_driver_layout(void);
+
+// Buffer to render the next frame into
+// It is not read by the hardware until led_driver_present() is called
+uint8_t* led_driver_back_buffer(void);
+
+// Start sending the back buffer to the strip and swap the buffers
+// Waits only for the previous frame to finish, the new one is sent in the background
+// Returns true if the transmission was started
+bool led_driver_present(void);
+
+// Write one pixel, advance with pixel += layout->bytes_per_pixel
+static inline void led_driver_set_pixel(uint8_t *pixel, const led_pixel_layout_t *layout, uint8_t r, uint8_t g, uint8_t b)
+{
+    pixel[layout->r] = r;
+    pixel[layout->g] = g;
+    pixel[layout->b] = b;
+}
+
+// Write one pixel of an RGBW strip, see led_driver_has_white()
+static inline void led_driver_set_pixel_rgbw(uint8_t *pixel, const led_pixel_layout_t *layout, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+{
+    pixel[layout->r] = r;
+    pixel[layout->g] = g;
+    pixel[layout->b] = b;
+    pixel[layout->w] = w;
+}
+
+#endif // LED_DRIVER_H
@@ -0,0 +1,168 @@
+#include "led_effects.h"
+#include <string.h>
+#include "led_color.h"
+
+// Fire simulation tuning, see the well known Fire2012 sketch
+#define FIRE_COOLING 55
+#define FIRE_SPARKING 120
+
+// Time for one full cycle of the animated effects
+#define RAINBOW_CYCLE_MS 6144
+#define BREATHE_CYCLE_MS 4000
+#define CHASE_LEDS_PER_S 50
+
+static uint32_t rand_state = 0x12345678;
+
+// xorshift32, cheap enough to call per pixel in the frame loop
+static inline uint32_t fast_rand(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+// Expand an 8-bit value to the full 12-bit range (255 -> 4095)
+static inline uint16_t expand8(uint8_t v)
+{
+    return (uint16_t)((v << 4) | (v >> 4));
+}
+
+// Integer hue (0-1535) to a fully saturated 12-bit color
+static inline led_rgb_t hue_to_rgb(uint32_t hue)
+{
+    uint16_t up = expand8(hue & 0xFF);
+    uint16_t down = COLOR_MAX - up;
+    switch ((hue >> 8) % 6) {
+    case 0:  return (led_rgb_t){COLOR_MAX, up, 0};
+    case 1:  return (led_rgb_t){down, COLOR_MAX, 0};
+    case 2:  return (led_rgb_t){0, COLOR_MAX, up};
+    case 3:  return (led_rgb_t){0, down, COLOR_MAX};
+    case 4:  return (led_rgb_t){up, 0, COLOR_MAX};
+    default: return (led_rgb_t){COLOR_MAX, 0, down};
+    }
+}
+
+static void effect_solid(led_rgb_t *pixels, uint8_t *scratch, int count, const light_state_t *state, uint32_t now_ms)
+{
+    led_rgb_t color = {state->r, state->g, state->b};
+    for (int i = 0; i < count; i++) {
+        pixels[i] = color;
+    }
+}
+
+// One full rainbow spread over the strip, rotating over time
+static void effect_rainbow(led_rgb_t *pixels, uint8_t *scratch, int count, const light_state_t *state, uint32_t now_ms)
+{
+    // 16.16 fixed-point hue so the step stays exact on long strips
+    uint32_t hue = ((now_ms % RAINBOW_CYCLE_MS) * 1536 / RAINBOW_CYCLE_MS) << 16;
+    uint32_t step = (1536u << 16) / (uint32_t)count;
+    for (int i = 0; i < count; i++) {
+        pixels[i] = hue_to_rgb((hue >> 16) % 1536);
+        hue += step;
+    }
+}
+
+// A block of the base color running along the strip
+static void effect_chase(led_rgb_t *pixels, uint8_t *scratch, int count, const light_state_t *state, uint32_t now_ms)
+{
+    led_rgb_t color = {state->r, state->g, state->b};
+    int length = count / 10 > 0 ? count / 10 : 1;
+    int pos = (int)((now_ms * CHASE_LEDS_PER_S / 1000) % (uint32_t)count);
+
+    memset(pixels, 0, count * sizeof(led_rgb_t));
+    for (int i = 0; i < length; i++) {
+        pixels[pos] = color;
+        if (++pos == count) pos = 0;
+    }
+}
+
+// Base color fading in and out with a triangle wave
+static void effect_breathe(led_rgb_t *pixels, uint8_t *scratch, int count, const light_state_t *state, uint32_t now_ms)
+{
+    uint32_t phase = now_ms % BREATHE_CYCLE_MS;
+    uint32_t half = BREATHE_CYCLE_MS / 2;
+    uint32_t level = (phase < half ? phase : BREATHE_CYCLE_MS - phase) * COLOR_MAX / half;
+
+    led_rgb_t color = {
+        .r = (uint16_t)((state->r * level) >> 12),
+        .g = (uint16_t)((state->g * level) >> 12),
+        .b = (uint16_t)((state->b * level) >> 12),
+    };
+    for (int i = 0; i < count; i++) {
+        pixels[i] = color;
+    }
+}
+
+// Heat simulation mapped onto a black-red-yellow-white palette
+static void effect_fire(led_rgb_t *pixels, uint8_t *scratch, int count, const light_state_t *state, uint32_t now_ms)
+{
+    uint8_t *heat = scratch;
+
+    // Cool down every cell a little
+    uint32_t max_cooling = (FIRE_COOLING * 10) / count + 2;
+    for (int i = 0; i < count; i++) {
+        uint32_t cooling = fast_rand() % max_cooling;
+        heat[i] = heat[i] > cooling ? heat[i] - cooling : 0;
+    }
+
+    // Heat drifts up and diffuses
+    for (int i = count - 1; i >= 2; i--) {
+        heat[i] = (uint8_t)((heat[i - 1] + 2 * heat[i - 2]) / 3);
+    }
+
+    // Randomly ignite new sparks near the bottom
+    if (fast_rand() % 255 < FIRE_SPARKING) {
+        int y = (int)(fast_rand() % 7);
+        if (y < count) {
+            uint32_t spark = heat[y] + 160 + fast_rand() % 95;
+            heat[y] = spark > 255 ? 255 : (uint8_t)spark;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        uint8_t t192 = (uint8_t)((heat[i] * 191) >> 8);
+        uint16_t ramp = expand8((uint8_t)((t192 & 0x3F) << 2));
+        if (t192 & 0x80) {
+            pixels[i] = (led_rgb_t){COLOR_MAX, COLOR_MAX, ramp};
+        } else if (t192 & 0x40) {
+            pixels[i] = (led_rgb_t){COLOR_MAX, ramp, 0};
+        } else {
+            pixels[i] = (led_rgb_t){ramp, 0, 0};
+        }
+    }
+}
+
+static const led_effect_t effects[] = {
+    { .name = "solid",   .render = effect_solid,   .budget_ns_per_led = 200 },
+    { .name = "rainbow", .render = effect_rainbow, .budget_ns_per_led = 1000 },
+    { .name = "chase",   .render = effect_chase,   .budget_ns_per_led = 300 },
+    { .name = "fire",    .render = effect_fire,    .budget_ns_per_led = 2000 },
+    { .name = "breathe", .render = effect_breathe, .budget_ns_per_led = 300 },
+};
+
+#define EFFECT_COUNT ((int)(sizeof(effects) / sizeof(effects[0])))
+
+int led_effects_count(void) {
+    return EFFECT_COUNT;
+}
+
+const led_effect_t* led_effects_get(int index) {
+    if (index < 0 || index >= EFFECT_COUNT) {
+        return NULL;
+    }
+    return &effects[index];
+}
+
+int led_effects_find(const char *name) {
+    return led_effects_find_len(name, strlen(name));
+}
+
+int led_effects_find_len(const char *name, size_t len) {
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        if (strncmp(effects[i].name, name, len) == 0 && effects[i].name[len] == '\0') {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,44 @@
+#ifndef LED_EFFECTS_H
+#define LED_EFFECTS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lightstate.h"
+
+// One pixel with 12-bit (0-4095) color channels, before brightness and gamma
+typedef struct {
+    uint16_t r;
+    uint16_t g;
+    uint16_t b;
+} led_rgb_t;
+
+// Renders one frame of an effect into pixels[0..count-1]
+// scratch holds one byte of effect state per pixel that persists between frames,
+// state carries the base color, now_ms is a monotonic time in milliseconds
+typedef void (*led_effect_render_t)(led_rgb_t *pixels, uint8_t *scratch, int count,
+                                    const light_state_t *state, uint32_t now_ms);
+
+typedef struct {
+    const char *name;              // Name advertised to Home Assistant
+    led_effect_render_t render;
+    uint16_t budget_ns_per_led;    // Per-frame CPU budget of render(), per LED
+} led_effect_t;
+
+// Effect index 0 is always the plain solid color
+#define LED_EFFECT_SOLID 0
+
+// Number of entries in the effect table
+int led_effects_count(void);
+
+// Get an effect by index, NULL if the index is out of range
+const led_effect_t* led_effects_get(int index);
+
+// Look up an effect by name
+// Returns the effect index, or -1 if there is no effect with that name
+int led_effects_find(const char *name);
+
+// Look up an effect by a name that is not null terminated, such as a token in a payload
+int led_effects_find_len(const char *name, size_t len);
+
+#endif // LED_EFFECTS_H
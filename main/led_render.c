@@ -0,0 +1,119 @@
+#include "led_render.h"
+#include "esp_timer.h"
+
+#include "led_color.h"
+
+#if CONFIG_LED_TEMPORAL_DITHERING
+// A static level only keeps the strip refreshing when its 8-bit step is visible
+static inline bool needs_dithering(uint16_t level)
+{
+    return (level & 0xFF) != 0 && level < (CONFIG_LED_DITHER_MAX_LEVEL << 8);
+}
+#endif
+
+led_render_result_t led_render_pixels(uint8_t *frame, const led_pixel_layout_t *layout, int start, int count,
+                                      const light_state_t *state, led_rgb_t *effect_pixels, uint8_t *effect_scratch,
+                                      uint8_t frame_dither, uint32_t now_ms)
+{
+    const led_effect_t *effect = led_effects_get(state->effect);
+    uint8_t *pixel = frame + start * layout->bytes_per_pixel;
+    led_render_result_t result = { 0 };
+
+#if CONFIG_LED_TEMPORAL_DITHERING
+    // Offset neighbouring pixels so the strip does not flicker in lockstep
+    uint8_t dither = (uint8_t)(frame_dither + start * 0x4F);
+#else
+    const uint8_t dither = 0x80;    // Round to nearest
+    (void)frame_dither;
+#endif
+
+    if (!state->is_on || effect == NULL || state->effect == LED_EFFECT_SOLID || effect_pixels == NULL) {
+        // Static color: the gamma lookup is done once per frame
+        uint16_t r = 0, g = 0, b = 0, w = 0;
+        if (state->is_on) {
+            r = led_color_level(state->r, state->brightness);
+            g = led_color_level(state->g, state->brightness);
+            b = led_color_level(state->b, state->brightness);
+            w = led_color_level(state->w, state->brightness);
+        }
+        bool has_white = led_driver_has_white(layout);
+        if (has_white) {
+#if CONFIG_LED_WHITE_EXTRACTION
+            led_color_extract_white(&r, &g, &b, &w);
+#endif
+        } else {
+            led_color_fold_white(&r, &g, &b, w);
+            w = 0;
+        }
+#if CONFIG_LED_TEMPORAL_DITHERING
+        // Brighter colors are rounded once instead of being refreshed at LED_FPS forever
+        result.dithering = needs_dithering(r) || needs_dithering(g) || needs_dithering(b) || needs_dithering(w);
+        uint8_t dither_step = 0x4F;
+        if (!result.dithering) {
+            dither = 0x80;
+            dither_step = 0;
+        }
+#endif
+        if (has_white) {
+            for (int i = 0; i < count; i++) {
+                led_driver_set_pixel_rgbw(pixel, layout, led_color_dither(r, dither),
+                                                         led_color_dither(g, dither),
+                                                         led_color_dither(b, dither),
+                                                         led_color_dither(w, dither));
+                pixel += layout->bytes_per_pixel;
+#if CONFIG_LED_TEMPORAL_DITHERING
+                dither += dither_step;
+#endif
+            }
+        } else {
+            for (int i = 0; i < count; i++) {
+                led_driver_set_pixel(pixel, layout, led_color_dither(r, dither),
+                                                    led_color_dither(g, dither),
+                                                    led_color_dither(b, dither));
+                pixel += layout->bytes_per_pixel;
+#if CONFIG_LED_TEMPORAL_DITHERING
+                dither += dither_step;
+#endif
+            }
+        }
+    } else {
+        led_rgb_t *pixels = effect_pixels + start;
+        int64_t render_start = esp_timer_get_time();
+        effect->render(pixels, effect_scratch + start, count, state, now_ms);
+        uint32_t render_us = (uint32_t)(esp_timer_get_time() - render_start);
+        result.over_budget = render_us * 1000 > (uint32_t)effect->budget_ns_per_led * count;
+
+        uint16_t brightness = state->brightness;
+        if (led_driver_has_white(layout)) {
+            // Effects only produce RGB, the white channel gets the extracted white part
+            for (int i = 0; i < count; i++) {
+                uint16_t r = led_color_level(pixels[i].r, brightness);
+                uint16_t g = led_color_level(pixels[i].g, brightness);
+                uint16_t b = led_color_level(pixels[i].b, brightness);
+                uint16_t w = 0;
+#if CONFIG_LED_WHITE_EXTRACTION
+                led_color_extract_white(&r, &g, &b, &w);
+#endif
+                led_driver_set_pixel_rgbw(pixel, layout, led_color_dither(r, dither),
+                                                         led_color_dither(g, dither),
+                                                         led_color_dither(b, dither),
+                                                         led_color_dither(w, dither));
+                pixel += layout->bytes_per_pixel;
+#if CONFIG_LED_TEMPORAL_DITHERING
+                dither += 0x4F;
+#endif
+            }
+        } else {
+            for (int i = 0; i < count; i++) {
+                led_driver_set_pixel(pixel, layout, led_color_dither(led_color_level(pixels[i].r, brightness), dither),
+                                                    led_color_dither(led_color_level(pixels[i].g, brightness), dither),
+                                                    led_color_dither(led_color_level(pixels[i].b, brightness), dither));
+                pixel += layout->bytes_per_pixel;
+#if CONFIG_LED_TEMPORAL_DITHERING
+                dither += 0x4F;
+#endif
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,23 @@
+#ifndef LED_RENDER_H
+#define LED_RENDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "lightstate.h"
+#include "led_driver.h"
+#include "led_effects.h"
+
+// Outcome of rendering a range of pixels
+typedef struct {
+    bool dithering;     // Visible fractional levels are shown, temporal dithering needs more frames
+    bool over_budget;   // The effect took longer than its per-LED CPU budget
+} led_render_result_t;
+
+// Render count pixels of a light state into the frame, starting at LED start
+// effect_pixels and effect_scratch span the whole strip, without them every
+// effect falls back to the static color
+led_render_result_t led_render_pixels(uint8_t *frame, const led_pixel_layout_t *layout, int start, int count,
+                                      const light_state_t *state, led_rgb_t *effect_pixels, uint8_t *effect_scratch,
+                                      uint8_t frame_dither, uint32_t now_ms);
+
+#endif // LED_RENDER_H
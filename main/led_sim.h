@@ -0,0 +1,25 @@
+#ifndef LED_SIM_H
+#define LED_SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Simulated strip of the linux target, keeps the last CONFIG_LED_SIM_RECORD_FRAMES frames
+
+// One frame as it would have been sent to the strip, in wire order
+typedef struct {
+    uint32_t sequence;      // Number of frames sent before this one
+    int64_t timestamp_us;   // esp_timer time of led_driver_present()
+    const uint8_t *data;
+    size_t size;
+} led_sim_frame_t;
+
+// Number of frames sent since the driver was initialized
+uint32_t led_sim_frame_count(void);
+
+// Get a recorded frame, age 0 is the most recent one
+// Returns false if the frame is no longer (or not yet) recorded
+bool led_sim_get_frame(uint32_t age, led_sim_frame_t *out);
+
+#endif // LED_SIM_H
@@ -0,0 +1,50 @@
+#ifndef LEDCONFIG_H
+#define LEDCONFIG_H
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// Supported LED chips, these set the bit timing and bytes per pixel
+typedef enum {
+    LED_CHIP_WS2812B = 0,
+    LED_CHIP_SK6812,
+    LED_CHIP_SK6812_RGBW,   // Four channels, the white byte follows the color bytes
+    LED_CHIP_MAX
+} led_chip_t;
+
+// Order in which the color channels are sent on the wire
+typedef enum {
+    LED_ORDER_GRB = 0,
+    LED_ORDER_RGB,
+    LED_ORDER_BRG,
+    LED_ORDER_RBG,
+    LED_ORDER_GBR,
+    LED_ORDER_BGR,
+    LED_ORDER_MAX
+} led_color_order_t;
+
+// Structure for the LED strip hardware configuration
+typedef struct {
+    uint8_t gpio;        // Data pin
+    uint8_t chip;        // led_chip_t
+    uint8_t color_order; // led_color_order_t
+    uint16_t led_count;  // Number of LEDs on the strip
+} led_hw_config_t;
+
+// Maximum length of a segment name, including the null terminator
+#define LED_SEGMENT_NAME_LEN 16
+
+// A named range of LEDs, exposed as its own light entity
+typedef struct {
+    char name[LED_SEGMENT_NAME_LEN]; // Entity name, empty for the default name
+    uint16_t start;                  // Index of the first LED
+    uint16_t count;                  // Number of LEDs
+} led_segment_t;
+
+// Structure for the split of the strip into segments
+typedef struct {
+    uint8_t count;  // Number of used entries, at least 1
+    led_segment_t segments[CONFIG_LED_MAX_SEGMENTS];
+} led_segment_layout_t;
+
+#endif // LEDCONFIG_H
@@ -0,0 +1,73 @@
+#include "light_binary.h"
+#include "esp_log.h"
+
+#include "led_effects.h"
+
+static const char *TAG = "light_binary";
+
+static uint16_t read_u16(const uint8_t *data)
+{
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+static uint32_t read_u32(const uint8_t *data)
+{
+    return (uint32_t)read_u16(data) | ((uint32_t)read_u16(data + 2) << 16);
+}
+
+static void write_u16(uint8_t *data, uint16_t value)
+{
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)(value >> 8);
+}
+
+bool light_binary_parse_command(const uint8_t *data, size_t len, light_state_t *state, uint32_t *transition_ms)
+{
+    if (len != LIGHT_BINARY_LEN || data[0] != LIGHT_BINARY_VERSION) {
+        return false;
+    }
+
+    uint8_t fields = data[1];
+    if (fields & LIGHT_BINARY_STATE) {
+        state->is_on = data[2] != 0;
+    }
+    if (fields & LIGHT_BINARY_EFFECT) {
+        if (data[3] < led_effects_count()) {
+            state->effect = data[3];
+        } else {
+            ESP_LOGW(TAG, "Unknown effect: %u", data[3]);
+        }
+    }
+    if (fields & LIGHT_BINARY_BRIGHTNESS) {
+        state->brightness = read_u16(data + 4);
+    }
+    if (fields & LIGHT_BINARY_COLOR) {
+        state->r = read_u16(data + 6);
+        state->g = read_u16(data + 8);
+        state->b = read_u16(data + 10);
+        state->w = read_u16(data + 12);
+    }
+    if (fields & LIGHT_BINARY_TRANSITION) {
+        *transition_ms = read_u32(data + 14);
+    }
+    return true;
+}
+
+size_t light_binary_write_state(const light_state_t *state, uint8_t *buf, size_t size)
+{
+    if (size < LIGHT_BINARY_LEN) {
+        return 0;
+    }
+    buf[0] = LIGHT_BINARY_VERSION;
+    buf[1] = LIGHT_BINARY_STATE | LIGHT_BINARY_BRIGHTNESS | LIGHT_BINARY_COLOR | LIGHT_BINARY_EFFECT;
+    buf[2] = state->is_on ? 1 : 0;
+    buf[3] = state->effect;
+    write_u16(buf + 4, state->brightness);
+    write_u16(buf + 6, state->r);
+    write_u16(buf + 8, state->g);
+    write_u16(buf + 10, state->b);
+    write_u16(buf + 12, state->w);
+    write_u16(buf + 14, 0);
+    write_u16(buf + 16, 0);
+    return LIGHT_BINARY_LEN;
+}
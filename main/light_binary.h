@@ -0,0 +1,40 @@
+#ifndef LIGHT_BINARY_H
+#define LIGHT_BINARY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lightstate.h"
+
+// Fixed layout binary encoding of a light command or state, for clients that
+// do not need Home Assistant's JSON. Multi-byte fields are little endian.
+//
+//  offset  size  field
+//  0       1     version, LIGHT_BINARY_VERSION
+//  1       1     fields present, LIGHT_BINARY_* bits
+//  2       1     on (0 = off)
+//  3       1     effect index
+//  4       2     brightness (0-4095)
+//  6       8     r, g, b, w (0-4095 each)
+//  14      4     transition (ms)
+
+#define LIGHT_BINARY_VERSION 1
+#define LIGHT_BINARY_LEN 18
+
+// Fields present in a message, a command only applies the fields it sets
+#define LIGHT_BINARY_STATE       (1 << 0)
+#define LIGHT_BINARY_BRIGHTNESS  (1 << 1)
+#define LIGHT_BINARY_COLOR       (1 << 2)
+#define LIGHT_BINARY_EFFECT      (1 << 3)
+#define LIGHT_BINARY_TRANSITION  (1 << 4)
+
+// Apply a binary light command to state
+// Unknown effect indexes are ignored, transition_ms is only written when a transition is given
+// Returns false and leaves state untouched if the message has the wrong length or version
+bool light_binary_parse_command(const uint8_t *data, size_t len, light_state_t *state, uint32_t *transition_ms);
+
+// Write the complete state into buf, every field except the transition is set
+// Returns LIGHT_BINARY_LEN, or 0 if buf is too small
+size_t light_binary_write_state(const light_state_t *state, uint8_t *buf, size_t size);
+
+#endif // LIGHT_BINARY_H
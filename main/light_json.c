@@ -0,0 +1,417 @@
+#include "light_json.h"
+#include <string.h>
+#include "esp_log.h"
+
+#include "led_effects.h"
+
+// Deepest nesting of skipped values, deeper payloads are rejected
+#define JSON_MAX_DEPTH 8
+
+// Numbers are kept as thousandths, so transitions in seconds resolve to milliseconds
+#define JSON_NUMBER_SCALE 1000
+#define JSON_NUMBER_MAX 1000000000000000LL
+
+static const char *TAG = "light_json";
+
+// Cursor over the payload, pos never passes end
+typedef struct {
+    const char *pos;
+    const char *end;
+} json_reader_t;
+
+// A string token, pointing into the payload without the quotes and unescaped
+typedef struct {
+    const char *str;
+    size_t len;
+} json_token_t;
+
+static void skip_whitespace(json_reader_t *reader)
+{
+    while (reader->pos < reader->end &&
+           (*reader->pos == ' ' || *reader->pos == '\t' || *reader->pos == '\n' || *reader->pos == '\r')) {
+        reader->pos++;
+    }
+}
+
+// Peek at the next non-whitespace character, 0 at the end of the payload
+static char peek(json_reader_t *reader)
+{
+    skip_whitespace(reader);
+    return reader->pos < reader->end ? *reader->pos : 0;
+}
+
+// Consume the next non-whitespace character if it is c
+static bool consume(json_reader_t *reader, char c)
+{
+    if (peek(reader) != c) {
+        return false;
+    }
+    reader->pos++;
+    return true;
+}
+
+static bool token_equals(const json_token_t *token, const char *literal)
+{
+    size_t len = strlen(literal);
+    return token->len == len && memcmp(token->str, literal, len) == 0;
+}
+
+static bool read_string(json_reader_t *reader, json_token_t *token)
+{
+    if (!consume(reader, '"')) {
+        return false;
+    }
+    token->str = reader->pos;
+    while (reader->pos < reader->end) {
+        char c = *reader->pos++;
+        if (c == '"') {
+            token->len = (size_t)(reader->pos - 1 - token->str);
+            return true;
+        }
+        if (c == '\\') {
+            reader->pos++;  // Escaped character, never ends the string
+        }
+    }
+    return false;
+}
+
+// Read a number as a multiple of 1/JSON_NUMBER_SCALE, saturating at +-JSON_NUMBER_MAX
+static bool read_number(json_reader_t *reader, int64_t *value)
+{
+    skip_whitespace(reader);
+    bool negative = reader->pos < reader->end && *reader->pos == '-';
+    if (negative) {
+        reader->pos++;
+    }
+
+    int64_t result = 0;
+    int digits = 0;
+    int scale = 0;          // Decimal exponent still to apply to result
+    while (reader->pos < reader->end && *reader->pos >= '0' && *reader->pos <= '9') {
+        if (result < JSON_NUMBER_MAX) {
+            result = result * 10 + (*reader->pos - '0');
+        } else {
+            scale++;
+        }
+        reader->pos++;
+        digits++;
+    }
+    if (digits == 0) {
+        return false;
+    }
+
+    if (reader->pos < reader->end && *reader->pos == '.') {
+        reader->pos++;
+        digits = 0;
+        while (reader->pos < reader->end && *reader->pos >= '0' && *reader->pos <= '9') {
+            if (result < JSON_NUMBER_MAX) {
+                result = result * 10 + (*reader->pos - '0');
+                scale--;
+            }
+            reader->pos++;
+            digits++;
+        }
+        if (digits == 0) {
+            return false;
+        }
+    }
+
+    if (reader->pos < reader->end && (*reader->pos == 'e' || *reader->pos == 'E')) {
+        reader->pos++;
+        bool negative_exponent = false;
+        if (reader->pos < reader->end && (*reader->pos == '+' || *reader->pos == '-')) {
+            negative_exponent = *reader->pos == '-';
+            reader->pos++;
+        }
+        int exponent = 0;
+        digits = 0;
+        while (reader->pos < reader->end && *reader->pos >= '0' && *reader->pos <= '9') {
+            if (exponent < 100) {
+                exponent = exponent * 10 + (*reader->pos - '0');
+            }
+            reader->pos++;
+            digits++;
+        }
+        if (digits == 0) {
+            return false;
+        }
+        scale += negative_exponent ? -exponent : exponent;
+    }
+
+    // Move the value to the fixed-point scale of 10^3
+    for (scale += 3; scale > 0 && result != 0; scale--) {
+        if (result >= JSON_NUMBER_MAX / 10) {
+            result = JSON_NUMBER_MAX;
+            break;
+        }
+        result *= 10;
+    }
+    for (; scale < 0 && result != 0; scale++) {
+        result /= 10;
+    }
+
+    *value = negative ? -result : result;
+    return true;
+}
+
+static bool read_literal(json_reader_t *reader, const char *literal)
+{
+    size_t len = strlen(literal);
+    skip_whitespace(reader);
+    if ((size_t)(reader->end - reader->pos) < len || memcmp(reader->pos, literal, len) != 0) {
+        return false;
+    }
+    reader->pos += len;
+    return true;
+}
+
+// Skip over any value, including nested objects and arrays
+static bool skip_value(json_reader_t *reader, int depth)
+{
+    json_token_t token;
+    int64_t number;
+
+    switch (peek(reader)) {
+    case '"':
+        return read_string(reader, &token);
+    case 't':
+        return read_literal(reader, "true");
+    case 'f':
+        return read_literal(reader, "false");
+    case 'n':
+        return read_literal(reader, "null");
+    case '{':
+    case '[': {
+        char close = *reader->pos == '{' ? '}' : ']';
+        bool object = close == '}';
+        reader->pos++;
+        if (depth >= JSON_MAX_DEPTH) {
+            return false;
+        }
+        if (consume(reader, close)) {
+            return true;
+        }
+        do {
+            if (object && (!read_string(reader, &token) || !consume(reader, ':'))) {
+                return false;
+            }
+            if (!skip_value(reader, depth + 1)) {
+                return false;
+            }
+        } while (consume(reader, ','));
+        return consume(reader, close);
+    }
+    default:
+        return read_number(reader, &number);
+    }
+}
+
+// Read a number value if the next value is one, other types are skipped
+// Returns false only on malformed JSON, *present tells whether a number was read
+static bool read_number_value(json_reader_t *reader, int64_t *value, bool *present)
+{
+    char c = peek(reader);
+    *present = c == '-' || (c >= '0' && c <= '9');
+    return *present ? read_number(reader, value) : skip_value(reader, 1);
+}
+
+// Read a string value if the next value is one, other types are skipped
+static bool read_string_value(json_reader_t *reader, json_token_t *token, bool *present)
+{
+    *present = peek(reader) == '"';
+    return *present ? read_string(reader, token) : skip_value(reader, 1);
+}
+
+// Integer part of a number, clamped to a 16-bit channel value
+static uint16_t to_channel(int64_t value)
+{
+    value /= JSON_NUMBER_SCALE;
+    return value < 0 ? 0 : value > UINT16_MAX ? UINT16_MAX : (uint16_t)value;
+}
+
+static bool parse_color(json_reader_t *reader, light_state_t *state)
+{
+    if (peek(reader) != '{') {
+        return skip_value(reader, 1);
+    }
+    reader->pos++;
+    if (consume(reader, '}')) {
+        return true;
+    }
+
+    do {
+        json_token_t key;
+        if (!read_string(reader, &key) || !consume(reader, ':')) {
+            return false;
+        }
+
+        uint16_t *channel = NULL;
+        if (token_equals(&key, "r")) {
+            channel = &state->r;
+        } else if (token_equals(&key, "g")) {
+            channel = &state->g;
+        } else if (token_equals(&key, "b")) {
+            channel = &state->b;
+        } else if (token_equals(&key, "w")) {
+            channel = &state->w;
+        }
+
+        if (channel == NULL) {
+            if (!skip_value(reader, 2)) {
+                return false;
+            }
+            continue;
+        }
+
+        int64_t value;
+        bool present;
+        if (!read_number_value(reader, &value, &present)) {
+            return false;
+        }
+        if (present) {
+            *channel = to_channel(value);
+        }
+    } while (consume(reader, ','));
+    return consume(reader, '}');
+}
+
+bool light_json_parse_command(const char *json, size_t len, light_state_t *state, uint32_t *transition_ms) {
+    json_reader_t reader = { .pos = json, .end = json + len };
+    light_state_t parsed;
+    uint32_t transition = *transition_ms;
+    memcpy(&parsed, state, sizeof(light_state_t));
+
+    if (!consume(&reader, '{')) {
+        return false;
+    }
+    if (!consume(&reader, '}')) {
+        do {
+            json_token_t key;
+            if (!read_string(&reader, &key) || !consume(&reader, ':')) {
+                return false;
+            }
+
+            bool ok;
+            bool present;
+            json_token_t text;
+            int64_t number;
+            if (token_equals(&key, "state")) {
+                ok = read_string_value(&reader, &text, &present);
+                if (ok && present) {
+                    parsed.is_on = token_equals(&text, "ON");
+                }
+            } else if (token_equals(&key, "brightness")) {
+                ok = read_number_value(&reader, &number, &present);
+                if (ok && present) {
+                    parsed.brightness = to_channel(number);
+                }
+            } else if (token_equals(&key, "color")) {
+                ok = parse_color(&reader, &parsed);
+            } else if (token_equals(&key, "transition")) {
+                // Given in seconds, the number is already kept in thousandths
+                ok = read_number_value(&reader, &number, &present);
+                if (ok && present && number > 0) {
+                    transition = number > UINT32_MAX ? UINT32_MAX : (uint32_t)number;
+                }
+            } else if (token_equals(&key, "effect")) {
+                // Unknown effect names are ignored
+                ok = read_string_value(&reader, &text, &present);
+                if (ok && present) {
+                    int effect = led_effects_find_len(text.str, text.len);
+                    if (effect >= 0) {
+                        parsed.effect = (uint8_t)effect;
+                    } else {
+                        ESP_LOGW(TAG, "Unknown effect: %.*s", (int)text.len, text.str);
+                    }
+                }
+            } else {
+                ok = skip_value(&reader, 1);
+            }
+            if (!ok) {
+                return false;
+            }
+        } while (consume(&reader, ','));
+
+        if (!consume(&reader, '}')) {
+            return false;
+        }
+    }
+
+    // Only whitespace or a terminating null may follow the object
+    if (peek(&reader) != 0) {
+        return false;
+    }
+
+    memcpy(state, &parsed, sizeof(light_state_t));
+    *transition_ms = transition;
+    return true;
+}
+
+// Bounded string builder, len keeps counting past size so overflow can be detected
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} json_writer_t;
+
+static void write_raw(json_writer_t *writer, const char *str)
+{
+    while (*str) {
+        if (writer->len < writer->size) {
+            writer->buf[writer->len] = *str;
+        }
+        writer->len++;
+        str++;
+    }
+}
+
+static void write_uint(json_writer_t *writer, uint32_t value)
+{
+    char digits[10];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (count > 0) {
+        if (writer->len < writer->size) {
+            writer->buf[writer->len] = digits[count - 1];
+        }
+        writer->len++;
+        count--;
+    }
+}
+
+size_t light_json_write_state(const light_state_t *state, char *buf, size_t size) {
+    json_writer_t writer = { .buf = buf, .size = size, .len = 0 };
+
+    write_raw(&writer, state->is_on ? "{\"state\":\"ON\",\"brightness\":" : "{\"state\":\"OFF\",\"brightness\":");
+    write_uint(&writer, state->brightness);
+    write_raw(&writer, ",\"color\":{\"r\":");
+    write_uint(&writer, state->r);
+    write_raw(&writer, ",\"g\":");
+    write_uint(&writer, state->g);
+    write_raw(&writer, ",\"b\":");
+    write_uint(&writer, state->b);
+    write_raw(&writer, ",\"w\":");
+    write_uint(&writer, state->w);
+    write_raw(&writer, "}");
+
+    // Effect names are plain identifiers, they need no escaping
+    const led_effect_t *effect = led_effects_get(state->effect);
+    if (effect != NULL) {
+        write_raw(&writer, ",\"effect\":\"");
+        write_raw(&writer, effect->name);
+        write_raw(&writer, "\"");
+    }
+    write_raw(&writer, "}");
+
+    if (writer.len >= size) {
+        if (size > 0) {
+            buf[0] = '\0';
+        }
+        return 0;
+    }
+    buf[writer.len] = '\0';
+    return writer.len;
+}
@@ -0,0 +1,25 @@
+#ifndef LIGHT_JSON_H
+#define LIGHT_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lightstate.h"
+
+// JSON of the Home Assistant light schema, without cJSON and without touching the heap
+
+// Apply a light command to state
+// Reads exactly len bytes of json, the payload does not need to be null terminated
+// Handles state, brightness, color.{r,g,b,w}, transition (seconds) and effect,
+// other keys are skipped. transition_ms is only written when a transition is given
+// Returns false and leaves state untouched if the payload is not a valid JSON object
+bool light_json_parse_command(const char *json, size_t len, light_state_t *state, uint32_t *transition_ms);
+
+// Buffer size that fits any state written by light_json_write_state()
+#define LIGHT_JSON_STATE_MAX_LEN 128
+
+// Write the complete state as compact JSON into buf, null terminated
+// Returns the length without the terminator, or 0 if buf is too small
+size_t light_json_write_state(const light_state_t *state, char *buf, size_t size);
+
+#endif // LIGHT_JSON_H
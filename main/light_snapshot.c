@@ -0,0 +1,33 @@
+#include "light_snapshot.h"
+#include <string.h>
+
+void light_snapshot_publish(light_snapshot_t *snapshot, const light_state_t *state, uint32_t transition_ms)
+{
+    uint32_t next = __atomic_load_n(&snapshot->version, __ATOMIC_RELAXED) + 1;
+
+    // Readers may still copy the slot published two versions ago, the previous
+    // version must be visible before that slot is overwritten
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&snapshot->slots[next & 1], state, sizeof(light_state_t));
+    snapshot->transition_ms[next & 1] = transition_ms;
+    __atomic_store_n(&snapshot->version, next, __ATOMIC_RELEASE);
+}
+
+uint32_t light_snapshot_read(const light_snapshot_t *snapshot, light_state_t *out, uint32_t *transition_ms)
+{
+    while (1) {
+        uint32_t version = __atomic_load_n(&snapshot->version, __ATOMIC_ACQUIRE);
+        memcpy(out, &snapshot->slots[version & 1], sizeof(light_state_t));
+        uint32_t fade_ms = snapshot->transition_ms[version & 1];
+
+        // A new version means the writer may have been filling this slot during the copy
+        // The writer never waits for readers, so a retry only happens after a completed publish
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&snapshot->version, __ATOMIC_RELAXED) == version) {
+            if (transition_ms != NULL) {
+                *transition_ms = fade_ms;
+            }
+            return version;
+        }
+    }
+}
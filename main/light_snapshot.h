@@ -0,0 +1,29 @@
+#ifndef LIGHT_SNAPSHOT_H
+#define LIGHT_SNAPSHOT_H
+
+#include <stdint.h>
+#include "lightstate.h"
+
+// Light state handed from one writer task to readers on other tasks without a lock
+// The writer fills the slot that is not published and then bumps the version,
+// readers copy the published slot and retry if the version moved meanwhile
+typedef struct {
+    light_state_t slots[2];
+    uint32_t transition_ms[2];  // Fade requested with the state of the same slot
+    uint32_t version;   // slots[version & 1] holds the published state
+} light_snapshot_t;
+
+// Publish a new state and the fade into it, only one task may call this for a given snapshot
+void light_snapshot_publish(light_snapshot_t *snapshot, const light_state_t *state, uint32_t transition_ms);
+
+// Copy a consistent published state into out, and its fade into transition_ms unless it is NULL
+// Returns the version of the copied state
+uint32_t light_snapshot_read(const light_snapshot_t *snapshot, light_state_t *out, uint32_t *transition_ms);
+
+// Version of the published state, changes with every light_snapshot_publish()
+static inline uint32_t light_snapshot_version(const light_snapshot_t *snapshot)
+{
+    return __atomic_load_n(&snapshot->version, __ATOMIC_ACQUIRE);
+}
+
+#endif // LIGHT_SNAPSHOT_H
@@ -11,6 +11,7 @@ typedef struct {
     uint16_t b;          // Blue color component (0-4095)
     uint16_t w;          // White color component (0-4095)
     uint16_t brightness; // Overall brightness (0-4095)
+    uint8_t effect;      // Index in the effect table (0 = solid color)
 } light_state_t;
 
 #endif // LIGHTSTATE_H
\ No newline at end of file
@@ -8,13 +8,11 @@
 
 #include "mqtt.h"
 
-#include "esp_ws28xx.h"
-#define LED_GPIO 6
-#define LED_NUM 30
+#include "led_control.h"
+#include "realtime.h"
 
 #include "device_config.h"
-
-CRGB* ws2812_buffer;
+#include "boot_timing.h"
 
 static const char TAG_wifi[] = "Wi-Fi";
 void cb_connection_ok(void *pvParameter){
@@ -25,53 +23,38 @@ void cb_connection_ok(void *pvParameter){
 	esp_ip4addr_ntoa(&param->ip_info.ip, str_ip, IP4ADDR_STRLEN_MAX);
 
 	ESP_LOGI(TAG_wifi, "I have a connection and my IP is %s!", str_ip);
+	boot_timing_mark(BOOT_GOT_IP);
 
-    // Initialize device configuration first
-    if (!device_config_init()) {
-        ESP_LOGE(TAG_wifi, "Failed to initialize device configuration!");
-        return;
-    }
-    
 	mqtt_app_start();
 }
 
 static const char TAG_led[] = "LED";
-static void configure_led(void)
-{
-    ESP_LOGI(TAG_led, "Initialised LED strip");
-    ws28xx_init(LED_GPIO, WS2812B, LED_NUM, &ws2812_buffer);
-}
 
-static void set_led(void)
+void app_main(void)
 {
-    light_state_t* stLightState = mqtt_get_light_state();
-    for (int i = 0; i < LED_NUM; i++) {
-        if (!stLightState->is_on)
-            ws2812_buffer[i] = (CRGB){.r = 0, .g = 0, .b = 0};
-        else
-            ws2812_buffer[i] = (CRGB){.r = stLightState->r, .g = stLightState->g, .b = stLightState->b};
-    }
-    ws28xx_update();
-}
+    boot_timing_mark(BOOT_APP_MAIN);
 
-void led_control(void *pvParameters) {
-    /* Configure the peripheral according to the LED type */
-    configure_led();
-    while (1) {
-        set_led();
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+    // Initialize device configuration first, the LED strip is sized from it
+    if (!device_config_init()) {
+        ESP_LOGE(TAG_led, "Failed to initialize device configuration!");
     }
-}
+    boot_timing_mark(BOOT_NVS_INIT);
+
+    // The strip shows the last state right away, without waiting for Wi-Fi and MQTT
+    mqtt_restore_light_states();
+
+	// Create a FreeRTOS task
+    ESP_LOGI(TAG_led, "Started led_control");
+    xTaskCreate(&led_control, "led_control", 4096, NULL, 5, NULL);
 
-void app_main(void)
-{
     /* start the wifi manager */
 	wifi_manager_start();
+	boot_timing_mark(BOOT_WIFI_START);
 
 	/* register a callback as an example to how you can integrate your code with the wifi manager */
 	wifi_manager_set_callback(WM_EVENT_STA_GOT_IP, &cb_connection_ok);
 
-	// Create a FreeRTOS task
-    ESP_LOGI(TAG_led, "Started led_control");
-    xTaskCreate(&led_control, "led_control", 2048, NULL, 5, NULL);
+#if CONFIG_REALTIME_ENABLE
+    realtime_start();
+#endif
 }
\ No newline at end of file
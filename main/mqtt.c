@@ -1,36 +1,125 @@
 #include <stdio.h>
 #include <string.h>
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
 #include "mqtt_client.h"
 #include <cJSON.h>
 #include "mqtt.h"
 #include "device_config.h"
+#include "led_control.h"
+#include "led_effects.h"
+#include "light_snapshot.h"
+#include "light_json.h"
+#include "light_binary.h"
+#include "entity.h"
+#include "mqtt_outbox.h"
+#include "boot_timing.h"
+#include "fnv1a.h"
 
 
 static const char *TAG_mqtt = "mqtt";
 
+// Home Assistant publishes "online" here when it starts and expects discovery again
+#define HA_STATUS_TOPIC "homeassistant/status"
+
+// How often the command and publish counters are logged
+#define STATS_LOG_INTERVAL_MS 60000
+
+// Largest state payload of any entity
+#define STATE_PAYLOAD_MAX_LEN 128
+_Static_assert(LIGHT_JSON_STATE_MAX_LEN <= STATE_PAYLOAD_MAX_LEN, "light state must fit the publish buffer");
+
 // MQTT topics - will be set dynamically based on device ID
-static char config_topic[64];
-static char command_topic[64];
-static char state_topic[64];
-static char unique_id[64];
-
-// Global light state
-static light_state_t stLightState = {
-    .is_on = false,
-    .r = 0,
-    .g = 0,
-    .b = 0,
-    .w = 0,
-    .brightness = 0
-};
+// The entity topics are derived by the entity registry, there is a light per segment
+static char led_config_topic[64];
+static int light_count = 0;
+static const entity_t *light_entities[CONFIG_LED_MAX_SEGMENTS];
+
+// Binary light topics, anythingiot/<device_id>/bin/<segment>/set and .../state
+static char binary_topic_prefix[48];
+
+// Startup milestones, published retained once per boot
+static char boot_timing_topic[64];
+static bool boot_timing_published = false;
+
+// Presets, recalled by id on anythingiot/<device_id>/preset/recall or by name through the select entity
+// Saved from the current light states with {"id": 3, "name": "Evening"} on .../preset/save
+static char preset_recall_topic[64];
+static char preset_save_topic[64];
+static const entity_t *preset_entity = NULL;
+static int active_preset = -1;     // Preset the lights still show, -1 after any other command
+
+// Names accepted in the LED config message, in led_chip_t / led_color_order_t order
+static const char *led_chip_names[LED_CHIP_MAX] = { "WS2812B", "SK6812", "SK6812_RGBW" };
+static const char *led_order_names[LED_ORDER_MAX] = { "GRB", "RGB", "BRG", "RBG", "GBR", "BGR" };
+
+// Light state of each segment, only touched by the MQTT task
+static light_state_t stLightStates[CONFIG_LED_MAX_SEGMENTS];
+// Copies of stLightStates handed to the LED task, a command is published once fully parsed
+static light_snapshot_t published_states[CONFIG_LED_MAX_SEGMENTS];
+
+// Home Assistant discovery, built once per boot
+// Republished on connect only when its hash differs from the last acknowledged one
+static char *discovery_payloads[CONFIG_MQTT_MAX_ENTITIES];
+static uint32_t discovery_hash = 0;
+static int discovery_msg_ids[CONFIG_MQTT_MAX_ENTITIES];  // Unacknowledged QoS 1 publishes, 0 when done
+
+// Re-announce after a Home Assistant restart, delayed by a per-device offset
+static TimerHandle_t reannounce_timer = NULL;
+static uint32_t reannounce_delay_ms = 0;
+
+// Rate limited state publishing, a timer per entity sends the latest state
+// once the interval since the previous publish has passed
+static esp_mqtt_client_handle_t mqtt_client = NULL;   // Created on the first connection, reused after that
+static bool topics_initialized = false;     // Entities registered and discovery built, once per boot
+static bool connected = false;     // State publishes go to the outbox while false
+static TimerHandle_t publish_timers[CONFIG_MQTT_MAX_ENTITIES];
+static bool publish_pending[CONFIG_MQTT_MAX_ENTITIES];
+static int64_t last_publish_us[CONFIG_MQTT_MAX_ENTITIES];
+static mqtt_stats_t stats;
+static TimerHandle_t stats_timer = NULL;    // Logs the counters every STATS_LOG_INTERVAL_MS
+
+// Reassembly of payloads esp-mqtt delivers in chunks, only the first chunk carries the topic
+static char reassembly_arena[CONFIG_MQTT_REASSEMBLY_BUFFER_SIZE];
+static char reassembly_topic[128];
+static int reassembly_topic_len = 0;
+static int reassembly_total = 0;        // Length of the message being reassembled
+static int reassembly_received = 0;
+static bool reassembly_active = false;
 
 // Forward declarations
-static void publish_config(esp_mqtt_client_handle_t client);
-static void publish_init_state(esp_mqtt_client_handle_t client);
-static bool parse_mqtt_message(const char *payload, light_state_t *state);
-static char *create_config(void);
+static void publish_config(esp_mqtt_client_handle_t client, const entity_t *entity);
+static void publish_discovery(esp_mqtt_client_handle_t client);
+static void build_discovery(void);
+static void handle_published(esp_mqtt_client_handle_t client, int msg_id);
+static void publish_boot_timing(esp_mqtt_client_handle_t client);
+static void schedule_reannounce(esp_mqtt_client_handle_t client);
+static void reannounce(esp_mqtt_client_handle_t client);
+static void restore_light_state(int segment);
+static void publish_state(esp_mqtt_client_handle_t client, const entity_t *entity);
+static void send_state(esp_mqtt_client_handle_t client, const char *topic, const char *payload, int len, bool enqueue);
+static void publish_binary_state(esp_mqtt_client_handle_t client, const entity_t *entity, bool enqueue);
+static bool handle_binary_command(esp_mqtt_client_handle_t client, const char *topic, int topic_len,
+                                  const char *data, int data_len);
+static void schedule_state_publish(esp_mqtt_client_handle_t client, const entity_t *entity);
+static char *create_config(const entity_t *entity);
 static void setup_topics(void);
+static void handle_led_config(const char *payload, int len);
+static void handle_preset_recall(esp_mqtt_client_handle_t client, const char *payload, int len);
+static void handle_preset_save(esp_mqtt_client_handle_t client, const char *payload, int len);
+static void clear_active_preset(esp_mqtt_client_handle_t client);
+static void handle_data(esp_mqtt_client_handle_t client, esp_mqtt_event_handle_t event);
+static void handle_message(esp_mqtt_client_handle_t client, const char *topic, int topic_len,
+                           const char *data, int data_len);
+
+// Check if the topic of a received message equals topic
+static bool topic_matches(const char *received, int received_len, const char *topic)
+{
+    return received_len == (int)strlen(topic) && strncmp(received, topic, received_len) == 0;
+}
 
 static void log_error_if_nonzero(const char *message, int error_code)
 {
@@ -58,13 +147,52 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     switch ((esp_mqtt_event_id_t)event_id) {
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG_mqtt, "MQTT_EVENT_CONNECTED");
-        esp_mqtt_client_subscribe(client, command_topic, 0);
-        publish_config(client);
+        boot_timing_mark(BOOT_MQTT_CONNECTED);
+        esp_mqtt_client_subscribe(client, led_config_topic, 1);
+        esp_mqtt_client_subscribe(client, HA_STATUS_TOPIC, 1);
+        esp_mqtt_client_subscribe(client, preset_recall_topic, 0);
+        esp_mqtt_client_subscribe(client, preset_save_topic, 1);
+#if CONFIG_MQTT_BINARY_TOPICS
+        {
+            char binary_filter[64];
+            snprintf(binary_filter, sizeof(binary_filter), "%s+/set", binary_topic_prefix);
+            esp_mqtt_client_subscribe(client, binary_filter, 0);
+        }
+#endif
+
+        // Discovery messages are retained, the broker still has them unless they changed
+        if (device_config_get_discovery_hash() != discovery_hash) {
+            publish_discovery(client);
+        } else {
+            ESP_LOGI(TAG_mqtt, "Discovery unchanged (hash %08" PRIx32 "), not republished", discovery_hash);
+            boot_timing_mark(BOOT_DISCOVERY_PUBLISHED);
+        }
+
+        // What was published while offline first, at most one message per topic
+        // It already holds the latest state of the entities that changed, the others are published below
+        {
+            bool flushed[CONFIG_MQTT_MAX_ENTITIES];
+            for (int i = 0; i < entity_count(); i++) {
+                flushed[i] = mqtt_outbox_contains(entity_get(i)->state_topic);
+            }
+            __atomic_store_n(&connected, true, __ATOMIC_SEQ_CST);
+            mqtt_outbox_flush(client);
 
-        publish_init_state(client);
+            for (int i = 0; i < entity_count(); i++) {
+                const entity_t *entity = entity_get(i);
+                if (entity->command_topic[0] != '\0') {
+                    esp_mqtt_client_subscribe(client, entity->command_topic, 0);
+                }
+                if (!flushed[i]) {
+                    publish_state(client, entity);
+                }
+            }
+        }
+        publish_boot_timing(client);
         break;
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(TAG_mqtt, "MQTT_EVENT_DISCONNECTED");
+        __atomic_store_n(&connected, false, __ATOMIC_SEQ_CST);
         break;
 
     case MQTT_EVENT_SUBSCRIBED:
@@ -74,14 +202,14 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         break;
     case MQTT_EVENT_PUBLISHED:
         ESP_LOGI(TAG_mqtt, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+        handle_published(client, event->msg_id);
         break;
     case MQTT_EVENT_DATA:
-        if (parse_mqtt_message(event->data, &stLightState)) {
-            // Store the new state in NVS
-            device_config_store_light_state(&stLightState);
-
-            esp_mqtt_client_publish(client, state_topic, event->data, event->data_len, 0, true);
-        }
+        handle_data(client, event);
+        break;
+    case MQTT_USER_EVENT:
+        // Posted by the re-announce timer, so the publishes run on the MQTT task
+        reannounce(client);
         break;
     case MQTT_EVENT_ERROR:
         ESP_LOGI(TAG_mqtt, "MQTT_EVENT_ERROR");
@@ -99,80 +227,512 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     }
 }
 
-// Create and publish initial state JSON
-static void publish_init_state(esp_mqtt_client_handle_t client) {
-    light_state_t* last_known_state = device_config_get_light_state();
-    stLightState.is_on = last_known_state->is_on;
-    stLightState.g = last_known_state->g;
-    stLightState.b = last_known_state->b;
-    stLightState.w = last_known_state->w;
-    stLightState.brightness = last_known_state->brightness;
-    stLightState.r = last_known_state->r;
+// Dispatch a complete message to the LED config, Home Assistant status or an entity
+static void handle_message(esp_mqtt_client_handle_t client, const char *topic, int topic_len,
+                           const char *data, int data_len)
+{
+    if (topic_matches(topic, topic_len, led_config_topic)) {
+        handle_led_config(data, data_len);
+        return;
+    }
 
-    cJSON *root = cJSON_CreateObject();
-    
-    // Add state (ON/OFF)
-    cJSON_AddStringToObject(root, "state", stLightState.is_on ? "ON" : "OFF");
-    
-    // Add brightness
-    cJSON_AddNumberToObject(root, "brightness", stLightState.brightness);
-    
-    // Add color
-    cJSON *color = cJSON_CreateObject();
-    cJSON_AddNumberToObject(color, "r", stLightState.r);
-    cJSON_AddNumberToObject(color, "g", stLightState.g);
-    cJSON_AddNumberToObject(color, "b", stLightState.b);
-    cJSON_AddNumberToObject(color, "w", stLightState.w);
-
-    // Add color JSON to state json
-    cJSON_AddItemToObject(root, "color", color);
-    
-    // Convert to string
-    char *payload = cJSON_Print(root);
-    
-    // Publish
-    esp_mqtt_client_publish(client, state_topic, payload, 0, 0, true);
-    ESP_LOGI(TAG_mqtt, "Published state: %s", payload);
-    
-    // Cleanup
-    free(payload);
+    // Home Assistant (re)started and lost its entities, announce them again
+    if (topic_matches(topic, topic_len, HA_STATUS_TOPIC)) {
+        if (data_len == 6 && strncmp(data, "online", 6) == 0) {
+            schedule_reannounce(client);
+        }
+        return;
+    }
+
+    if (topic_matches(topic, topic_len, preset_recall_topic)) {
+        stats.commands++;
+        handle_preset_recall(client, data, data_len);
+        return;
+    }
+    if (topic_matches(topic, topic_len, preset_save_topic)) {
+        handle_preset_save(client, data, data_len);
+        return;
+    }
+
+    if (handle_binary_command(client, topic, topic_len, data, data_len)) {
+        return;
+    }
+
+    // One hash of the topic finds the entity, however many the device hosts
+    const entity_t *entity = entity_find_by_command_topic(topic, topic_len);
+    if (entity != NULL) {
+        stats.commands++;
+        if (entity->ops->command(entity, data, data_len)) {
+            // The full state, a command may only carry the fields that changed
+            schedule_state_publish(client, entity);
+        }
+    }
+}
+
+// Pass a whole message on as it is, chunks of a larger one are collected in the arena first
+static void handle_data(esp_mqtt_client_handle_t client, esp_mqtt_event_handle_t event)
+{
+    if (event->current_data_offset == 0 && event->data_len == event->total_data_len) {
+        // A new message abandons an incomplete one, the broker will not send its missing chunks
+        reassembly_active = false;
+        handle_message(client, event->topic, event->topic_len, event->data, event->data_len);
+        return;
+    }
+
+    if (event->current_data_offset == 0) {
+        reassembly_active = false;
+        if (event->total_data_len > (int)sizeof(reassembly_arena) ||
+            event->topic_len >= (int)sizeof(reassembly_topic)) {
+            stats.dropped++;
+            ESP_LOGW(TAG_mqtt, "Dropped %d byte message on %.*s, larger than the reassembly buffer",
+                     event->total_data_len, event->topic_len, event->topic);
+            return;
+        }
+        memcpy(reassembly_topic, event->topic, event->topic_len);
+        reassembly_topic_len = event->topic_len;
+        reassembly_total = event->total_data_len;
+        reassembly_received = 0;
+        reassembly_active = true;
+    }
+
+    if (!reassembly_active) {
+        // The rest of a dropped message
+        return;
+    }
+    if (event->current_data_offset != reassembly_received ||
+        event->data_len > reassembly_total - reassembly_received) {
+        stats.dropped++;
+        reassembly_active = false;
+        ESP_LOGW(TAG_mqtt, "Dropped message on %.*s, chunk out of sequence", reassembly_topic_len, reassembly_topic);
+        return;
+    }
+
+    memcpy(reassembly_arena + reassembly_received, event->data, event->data_len);
+    reassembly_received += event->data_len;
+    if (reassembly_received == reassembly_total) {
+        reassembly_active = false;
+        handle_message(client, reassembly_topic, reassembly_topic_len, reassembly_arena, reassembly_total);
+    }
+}
+
+// Publish a retained state message, or keep it in the outbox while the broker is unreachable
+// enqueue is set when called outside the MQTT task
+static void send_state(esp_mqtt_client_handle_t client, const char *topic, const char *payload, int len, bool enqueue) {
+    if (!__atomic_load_n(&connected, __ATOMIC_SEQ_CST)) {
+        mqtt_outbox_put(topic, payload, len, 0, true);
+    } else if (enqueue) {
+        esp_mqtt_client_enqueue(client, topic, payload, len, 0, true, true);
+    } else {
+        esp_mqtt_client_publish(client, topic, payload, len, 0, true);
+    }
+}
+
+// Publish the complete current state of an entity as retained compact JSON
+static void publish_state(esp_mqtt_client_handle_t client, const entity_t *entity) {
+    char payload[STATE_PAYLOAD_MAX_LEN];
+    size_t len = entity->ops->state(entity, payload, sizeof(payload));
+    if (len == 0) {
+        ESP_LOGE(TAG_mqtt, "State of %s does not fit the publish buffer", entity->unique_id);
+        return;
+    }
+    send_state(client, entity->state_topic, payload, (int)len, false);
+    ESP_LOGD(TAG_mqtt, "Published state: %.*s", (int)len, payload);
+    publish_binary_state(client, entity, false);
+    last_publish_us[entity->index] = esp_timer_get_time();
+    __atomic_fetch_add(&stats.published, 1, __ATOMIC_RELAXED);
+}
+
+// Runs on the timer task, the state callbacks read the snapshots instead of the MQTT task state
+// The message is queued for the MQTT task instead of being sent from here
+static void publish_timer_callback(TimerHandle_t timer) {
+    const entity_t *entity = entity_get((int)(intptr_t)pvTimerGetTimerID(timer));
+
+    // Cleared before the read: a command published after this point schedules its own publish
+    __atomic_store_n(&publish_pending[entity->index], false, __ATOMIC_SEQ_CST);
+
+    char payload[STATE_PAYLOAD_MAX_LEN];
+    size_t len = entity->ops->state(entity, payload, sizeof(payload));
+    if (len == 0) {
+        ESP_LOGE(TAG_mqtt, "State of %s does not fit the publish buffer", entity->unique_id);
+        return;
+    }
+    send_state(mqtt_client, entity->state_topic, payload, (int)len, true);
+    publish_binary_state(mqtt_client, entity, true);
+    last_publish_us[entity->index] = esp_timer_get_time();
+    __atomic_fetch_add(&stats.published, 1, __ATOMIC_RELAXED);
+}
+
+// Publish the state after a command, at most once per CONFIG_MQTT_STATE_PUBLISH_INTERVAL_MS
+// The state callback must already see the new state, the delayed publish runs on the timer task
+static void schedule_state_publish(esp_mqtt_client_handle_t client, const entity_t *entity) {
+    int index = entity->index;
+    if (__atomic_load_n(&publish_pending[index], __ATOMIC_SEQ_CST)) {
+        // The pending publish will carry this command's state
+        stats.coalesced++;
+        return;
+    }
+
+    int64_t elapsed_us = esp_timer_get_time() - last_publish_us[index];
+    int64_t remaining_ms = CONFIG_MQTT_STATE_PUBLISH_INTERVAL_MS - elapsed_us / 1000;
+    if (remaining_ms <= 0 || publish_timers[index] == NULL) {
+        publish_state(client, entity);
+        return;
+    }
+
+    __atomic_store_n(&publish_pending[index], true, __ATOMIC_SEQ_CST);
+    TickType_t delay = pdMS_TO_TICKS(remaining_ms);
+    if (xTimerChangePeriod(publish_timers[index], delay > 0 ? delay : 1, 0) != pdPASS) {
+        __atomic_store_n(&publish_pending[index], false, __ATOMIC_SEQ_CST);
+        publish_state(client, entity);
+    }
+}
+
+// Load the state restored from NVS and hand it to the LED task
+static void restore_light_state(int segment) {
+    light_state_t* last_known_state = device_config_get_light_state(segment);
+    light_state_t* stLightState = &stLightStates[segment];
+    memcpy(stLightState, last_known_state, sizeof(light_state_t));
+    light_snapshot_publish(&published_states[segment], stLightState, 0);
+    led_control_notify();
+}
+
+static int light_segment(const entity_t *entity) {
+    return (int)(intptr_t)entity->context;
+}
+
+// Apply a parsed command, stLightStates already holds the new state of the segment
+static void apply_light_command(int segment, uint32_t transition_ms) {
+    // Hand the new state to the LED task, the fade is published with it
+    light_snapshot_publish(&published_states[segment], &stLightStates[segment], transition_ms);
+    led_control_notify();
+
+    // Saved to NVS in the background once the state stops changing
+    device_config_store_light_state(segment, &stLightStates[segment]);
+}
+
+// Apply a JSON light command to the segment
+static bool light_command(const entity_t *entity, const char *payload, int len) {
+    int segment = light_segment(entity);
+    uint32_t transition_ms = 0;
+    if (!light_json_parse_command(payload, len, &stLightStates[segment], &transition_ms)) {
+        return false;
+    }
+    apply_light_command(segment, transition_ms);
+    clear_active_preset(mqtt_client);
+    return true;
+}
+
+#if CONFIG_MQTT_BINARY_TOPICS
+// Segment of a binary command topic, <binary_topic_prefix><segment>/set
+// Returns -1 if topic is not a binary command topic of an existing segment
+static int binary_command_segment(const char *topic, int topic_len) {
+    int prefix_len = (int)strlen(binary_topic_prefix);
+    if (topic_len <= prefix_len || strncmp(topic, binary_topic_prefix, prefix_len) != 0) {
+        return -1;
+    }
+    int pos = prefix_len;
+    int segment = 0;
+    int digits = 0;
+    while (pos < topic_len && topic[pos] >= '0' && topic[pos] <= '9' && digits < 3) {
+        segment = segment * 10 + (topic[pos++] - '0');
+        digits++;
+    }
+    if (digits == 0 || topic_len - pos != 4 || strncmp(topic + pos, "/set", 4) != 0 || segment >= light_count) {
+        return -1;
+    }
+    return segment;
+}
+#endif
+
+// Apply a command received on a binary light topic
+// Returns false if the topic is not a binary command topic
+static bool handle_binary_command(esp_mqtt_client_handle_t client, const char *topic, int topic_len,
+                                  const char *data, int data_len) {
+#if CONFIG_MQTT_BINARY_TOPICS
+    int segment = binary_command_segment(topic, topic_len);
+    if (segment < 0) {
+        return false;
+    }
+    stats.commands++;
+    uint32_t transition_ms = 0;
+    if (light_binary_parse_command((const uint8_t *)data, data_len, &stLightStates[segment], &transition_ms)) {
+        apply_light_command(segment, transition_ms);
+        schedule_state_publish(client, light_entities[segment]);
+        clear_active_preset(client);
+    } else {
+        ESP_LOGW(TAG_mqtt, "Invalid binary command for segment %d", segment);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Publish the state of a light in the binary layout next to its JSON state
+// enqueue is set when called outside the MQTT task
+static void publish_binary_state(esp_mqtt_client_handle_t client, const entity_t *entity, bool enqueue) {
+#if CONFIG_MQTT_BINARY_TOPICS
+    if (entity->type != ENTITY_LIGHT) {
+        return;
+    }
+    int segment = light_segment(entity);
+    light_state_t state;
+    mqtt_read_light_state(segment, &state);
+
+    uint8_t payload[LIGHT_BINARY_LEN];
+    size_t len = light_binary_write_state(&state, payload, sizeof(payload));
+    char topic[64];
+    snprintf(topic, sizeof(topic), "%s%d/state", binary_topic_prefix, segment);
+    send_state(client, topic, (const char *)payload, (int)len, enqueue);
+#endif
+}
+
+static size_t light_state(const entity_t *entity, char *buf, size_t size) {
+    light_state_t state;
+    mqtt_read_light_state(light_segment(entity), &state);
+    return light_json_write_state(&state, buf, size);
+}
+
+// JSON schema light with brightness, rgbw and the effect table
+static void light_discovery(const entity_t *entity, cJSON *config) {
+	cJSON *supported_color_modes = NULL;
+	cJSON *supported_color_modes_string = NULL;
+	cJSON *effect_list = NULL;
+
+	cJSON_AddStringToObject(config, "schema", "json");
+	cJSON_AddTrueToObject(config, "brightness");
+	cJSON_AddNumberToObject(config, "brightness_scale", 4095);
+	supported_color_modes = cJSON_AddArrayToObject(config, "supported_color_modes");
+	supported_color_modes_string = cJSON_CreateString("rgbw"); //could also use CJSON_PUBLIC(cJSON *) cJSON_CreateStringArray(const char *const *strings, int count); if more than 1 color
+	cJSON_AddItemToArray(supported_color_modes, supported_color_modes_string);	
+	
+	// advertise the effect table
+	cJSON_AddTrueToObject(config, "effect");
+	effect_list = cJSON_AddArrayToObject(config, "effect_list");
+	for (int i = 0; i < led_effects_count(); i++) {
+		cJSON_AddItemToArray(effect_list, cJSON_CreateString(led_effects_get(i)->name));
+	}
+}
+
+static const entity_ops_t light_ops = {
+    .discovery = light_discovery,
+    .command = light_command,
+    .state = light_state,
+};
+
+// Select option of a preset slot, unnamed and empty slots get a default name
+static void preset_label(int id, char *buf, size_t size) {
+    const light_preset_t *preset = device_config_get_preset(id);
+    if (preset != NULL && preset->name[0] != '\0') {
+        snprintf(buf, size, "%s", preset->name);
+    } else {
+        snprintf(buf, size, "Preset %d", id);
+    }
+}
+
+// Apply the stored states of a preset, they are copied as they are without any parsing
+// Returns false if the slot is empty
+static bool recall_preset(esp_mqtt_client_handle_t client, int id) {
+    const light_preset_t *preset = device_config_get_preset(id);
+    if (preset == NULL) {
+        ESP_LOGW(TAG_mqtt, "Preset %d is empty", id);
+        return false;
+    }
+    // Segments added since the preset was saved keep their state
+    int count = preset->segment_count < light_count ? preset->segment_count : light_count;
+    for (int i = 0; i < count; i++) {
+        stLightStates[i] = preset->states[i];
+        apply_light_command(i, 0);
+        schedule_state_publish(client, light_entities[i]);
+    }
+    __atomic_store_n(&active_preset, id, __ATOMIC_SEQ_CST);
+    ESP_LOGI(TAG_mqtt, "Recalled preset %d", id);
+    return true;
+}
+
+// The lights no longer show the recalled preset
+static void clear_active_preset(esp_mqtt_client_handle_t client) {
+    if (__atomic_exchange_n(&active_preset, -1, __ATOMIC_SEQ_CST) >= 0 && preset_entity != NULL) {
+        schedule_state_publish(client, preset_entity);
+    }
+}
+
+// Every slot is an option, so the list only changes when a preset is renamed
+static void preset_discovery(const entity_t *entity, cJSON *config) {
+    cJSON *options = cJSON_AddArrayToObject(config, "options");
+    for (int i = 0; i < CONFIG_LIGHT_PRESET_COUNT; i++) {
+        char label[LIGHT_PRESET_NAME_LEN + 8];
+        preset_label(i, label, sizeof(label));
+        cJSON_AddItemToArray(options, cJSON_CreateString(label));
+    }
+    cJSON_AddStringToObject(config, "icon", "mdi:palette");
+}
+
+// Recall the preset whose option Home Assistant selected
+static bool preset_command(const entity_t *entity, const char *payload, int len) {
+    for (int i = 0; i < CONFIG_LIGHT_PRESET_COUNT; i++) {
+        char label[LIGHT_PRESET_NAME_LEN + 8];
+        preset_label(i, label, sizeof(label));
+        if ((int)strlen(label) == len && strncmp(label, payload, len) == 0) {
+            return recall_preset(mqtt_client, i);
+        }
+    }
+    ESP_LOGW(TAG_mqtt, "Unknown preset %.*s", len, payload);
+    return false;
+}
+
+// The active preset, "None" is not an option so Home Assistant shows the select as unknown
+static size_t preset_state(const entity_t *entity, char *buf, size_t size) {
+    int id = __atomic_load_n(&active_preset, __ATOMIC_SEQ_CST);
+    char label[LIGHT_PRESET_NAME_LEN + 8];
+    if (id >= 0) {
+        preset_label(id, label, sizeof(label));
+    } else {
+        snprintf(label, sizeof(label), "None");
+    }
+    int len = snprintf(buf, size, "%s", label);
+    return len > 0 && (size_t)len < size ? (size_t)len : 0;
+}
+
+static const entity_ops_t preset_ops = {
+    .discovery = preset_discovery,
+    .command = preset_command,
+    .state = preset_state,
+};
+
+// Recall a preset by its id, the payload is the id in decimal, e.g. "3"
+static void handle_preset_recall(esp_mqtt_client_handle_t client, const char *payload, int len) {
+    int id = 0;
+    if (len == 0 || len > 3) {
+        id = -1;
+    }
+    for (int i = 0; i < len && id >= 0; i++) {
+        id = payload[i] >= '0' && payload[i] <= '9' ? id * 10 + (payload[i] - '0') : -1;
+    }
+    if (id < 0 || id >= CONFIG_LIGHT_PRESET_COUNT) {
+        ESP_LOGW(TAG_mqtt, "Invalid preset id %.*s", len, payload);
+        return;
+    }
+    if (recall_preset(client, id) && preset_entity != NULL) {
+        schedule_state_publish(client, preset_entity);
+    }
+}
+
+// Save the current state of every segment as a preset, e.g. {"id": 3, "name": "Evening"}
+// A new name changes the select options, so the discovery of the select is published again
+static void handle_preset_save(esp_mqtt_client_handle_t client, const char *payload, int len) {
+    cJSON *root = cJSON_ParseWithLength(payload, len);
+    if (root == NULL) {
+        ESP_LOGE(TAG_mqtt, "Invalid preset message");
+        return;
+    }
+    const cJSON *id = cJSON_GetObjectItemCaseSensitive(root, "id");
+    const cJSON *name = cJSON_GetObjectItemCaseSensitive(root, "name");
+    if (!cJSON_IsNumber(id) || id->valueint < 0 || id->valueint >= CONFIG_LIGHT_PRESET_COUNT ||
+        (name != NULL && (!cJSON_IsString(name) || strlen(name->valuestring) >= LIGHT_PRESET_NAME_LEN))) {
+        ESP_LOGE(TAG_mqtt, "Invalid preset message");
+        cJSON_Delete(root);
+        return;
+    }
+
+    light_preset_t preset;
+    memset(&preset, 0, sizeof(preset));
+    if (name != NULL) {
+        snprintf(preset.name, sizeof(preset.name), "%s", name->valuestring);
+    }
+    preset.segment_count = (uint8_t)light_count;
+    memcpy(preset.states, stLightStates, light_count * sizeof(light_state_t));
+    int slot = id->valueint;
     cJSON_Delete(root);
+
+    if (!device_config_store_preset(slot, &preset)) {
+        return;
+    }
+    ESP_LOGI(TAG_mqtt, "Saved preset %d", slot);
+
+    if (preset_entity != NULL) {
+        int index = preset_entity->index;
+        cJSON_free(discovery_payloads[index]);
+        discovery_payloads[index] = NULL;
+        build_discovery();
+        publish_config(client, preset_entity);
+        // The lights show what was just saved
+        __atomic_store_n(&active_preset, slot, __ATOMIC_SEQ_CST);
+        schedule_state_publish(client, preset_entity);
+    }
 }
 
-// Set up topic strings based on device ID
+// Register the entities based on device ID
+// Segment 0 keeps the original entity ids, the others get a _<index> suffix
 static void setup_topics(void) {
     char *device_id = device_config_get_id();
-    
-    snprintf(config_topic, sizeof(config_topic), "homeassistant/light/%s_light/config", device_id);
-    snprintf(command_topic, sizeof(command_topic), "homeassistant/light/%s_light/set", device_id);
-    snprintf(state_topic, sizeof(state_topic), "homeassistant/light/%s_light/state", device_id);
-    snprintf(unique_id, sizeof(unique_id), "%s_light", device_id);
+    const led_segment_layout_t *segments = device_config_get_segments();
+    light_count = segments->count;
+
+    for (int i = 0; i < light_count; i++) {
+        char unique_id[32];
+        char name[LED_SEGMENT_NAME_LEN + 16];
+        if (i == 0) {
+            snprintf(unique_id, sizeof(unique_id), "%s_light", device_id);
+        } else {
+            snprintf(unique_id, sizeof(unique_id), "%s_light_%d", device_id, i);
+        }
+        // unnamed segments get a default entity name
+        if (segments->segments[i].name[0] != '\0') {
+            snprintf(name, sizeof(name), "%s", segments->segments[i].name);
+        } else if (i == 0) {
+            snprintf(name, sizeof(name), "REGEBELEEGHT");
+        } else {
+            snprintf(name, sizeof(name), "Segment %d", i);
+        }
+        light_entities[i] = entity_register(ENTITY_LIGHT, unique_id, name, &light_ops, (void *)(intptr_t)i);
+    }
+    {
+        char unique_id[32];
+        snprintf(unique_id, sizeof(unique_id), "%s_preset", device_id);
+        preset_entity = entity_register(ENTITY_SELECT, unique_id, "Preset", &preset_ops, NULL);
+    }
+    snprintf(led_config_topic, sizeof(led_config_topic), "anythingiot/%s/led_config", device_id);
+    snprintf(binary_topic_prefix, sizeof(binary_topic_prefix), "anythingiot/%s/bin/", device_id);
+    snprintf(boot_timing_topic, sizeof(boot_timing_topic), "anythingiot/%s/diagnostics/boot", device_id);
+    snprintf(preset_recall_topic, sizeof(preset_recall_topic), "anythingiot/%s/preset/recall", device_id);
+    snprintf(preset_save_topic, sizeof(preset_save_topic), "anythingiot/%s/preset/save", device_id);
     
     ESP_LOGI(TAG_mqtt, "Topics configured with device ID %s", device_id);
-    ESP_LOGI(TAG_mqtt, "Config topic: %s", config_topic);
-    ESP_LOGI(TAG_mqtt, "Command topic: %s", command_topic);
-    ESP_LOGI(TAG_mqtt, "State topic: %s", state_topic);
+    for (int i = 0; i < entity_count(); i++) {
+        const entity_t *entity = entity_get(i);
+        ESP_LOGI(TAG_mqtt, "Config topic: %s", entity->config_topic);
+        if (entity->command_topic[0] != '\0') {
+            ESP_LOGI(TAG_mqtt, "Command topic: %s", entity->command_topic);
+        }
+        ESP_LOGI(TAG_mqtt, "State topic: %s", entity->state_topic);
+    }
+    ESP_LOGI(TAG_mqtt, "LED config topic: %s", led_config_topic);
+    ESP_LOGI(TAG_mqtt, "Preset topics: %s and %s", preset_recall_topic, preset_save_topic);
+#if CONFIG_MQTT_BINARY_TOPICS
+    ESP_LOGI(TAG_mqtt, "Binary light topics: %s<segment>/set and /state", binary_topic_prefix);
+#endif
 }
 
-char *create_config(void)
+char *create_config(const entity_t *entity)
 {
 	char *string = NULL;
-	cJSON *supported_color_modes = NULL;
-	cJSON *supported_color_modes_string = NULL;
 	
 	cJSON *identifier = NULL;
 	cJSON *identifier_string = NULL;
 	
 	cJSON *config = cJSON_CreateObject();
 	
-	if (cJSON_AddStringToObject(config, "name", "REGEBELEEGHT") == NULL)
+	if (cJSON_AddStringToObject(config, "name", entity->name) == NULL)
 	{
 		goto end;
 	}
 	
-	cJSON_AddStringToObject(config, "command_topic", command_topic);
-	cJSON_AddStringToObject(config, "state_topic", state_topic);
-	cJSON_AddStringToObject(config, "unique_id", unique_id);
+	if (entity->command_topic[0] != '\0') {
+		cJSON_AddStringToObject(config, "command_topic", entity->command_topic);
+	}
+	cJSON_AddStringToObject(config, "state_topic", entity->state_topic);
+	cJSON_AddStringToObject(config, "unique_id", entity->unique_id);
 	cJSON_AddStringToObject(config, "platform", "mqtt");
 	
 	//create device JSON
@@ -190,74 +750,286 @@ char *create_config(void)
 	// add device JSON to the config JSON
 	cJSON_AddItemToObject(config, "device", device);
 	
-	cJSON_AddStringToObject(config, "schema", "json");
-	cJSON_AddTrueToObject(config, "brightness");
-	cJSON_AddNumberToObject(config, "brightness_scale", 4095);
-	supported_color_modes = cJSON_AddArrayToObject(config, "supported_color_modes");
-	supported_color_modes_string = cJSON_CreateString("rgbw"); //could also use CJSON_PUBLIC(cJSON *) cJSON_CreateStringArray(const char *const *strings, int count); if more than 1 color
-	cJSON_AddItemToArray(supported_color_modes, supported_color_modes_string);	
-	string = cJSON_Print(config);
-	printf("%s \n", string);
-	
+	// the fields of the entity's platform
+	if (entity->ops->discovery != NULL) {
+		entity->ops->discovery(entity, config);
+	}
+	string = cJSON_PrintUnformatted(config);
 	
 end:
 	cJSON_Delete(config);
 	return string;
 }
 
-bool parse_mqtt_message(const char *payload, light_state_t *state) {
-    cJSON *root = cJSON_Parse(payload);
-    if (root == NULL) {
-        return false;
+// Look up a name in one of the LED config name tables
+// Returns the index, or -1 if the name is not in the table
+static int find_name(const char *const *names, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return i;
+        }
     }
+    return -1;
+}
 
-    // Always check and set state
-    cJSON *state_json = cJSON_GetObjectItemCaseSensitive(root, "state");
-    if (cJSON_IsString(state_json) && (state_json->valuestring != NULL)) {
-        state->is_on = (strcmp(state_json->valuestring, "ON") == 0);
+// Apply a retained LED hardware config message, e.g.
+// {"gpio": 6, "count": 300, "chip": "WS2812B", "order": "GRB",
+//  "segments": [{"name": "Desk", "start": 0, "count": 20}, ...]}
+// Missing hardware fields keep their current value, without "segments" the
+// whole strip is one light. The strip is sized at boot, so a changed config
+// is stored and the device restarts to apply it.
+static void handle_led_config(const char *payload, int len) {
+    cJSON *root = cJSON_ParseWithLength(payload, len);
+    if (root == NULL) {
+        ESP_LOGE(TAG_mqtt, "Invalid LED config message");
+        return;
     }
 
-    // Color parsing - only update if color is present
-    cJSON *color_json = cJSON_GetObjectItemCaseSensitive(root, "color");
-    if (cJSON_IsObject(color_json)) {
-        cJSON *r = cJSON_GetObjectItemCaseSensitive(color_json, "r");
-        cJSON *g = cJSON_GetObjectItemCaseSensitive(color_json, "g");
-        cJSON *b = cJSON_GetObjectItemCaseSensitive(color_json, "b");
-        cJSON *w = cJSON_GetObjectItemCaseSensitive(color_json, "w");
+    led_hw_config_t *current = device_config_get_led_config();
+    led_hw_config_t config = *current;
 
-        state->r = cJSON_IsNumber(r) ? r->valueint : state->r;
-        state->g = cJSON_IsNumber(g) ? g->valueint : state->g;
-        state->b = cJSON_IsNumber(b) ? b->valueint : state->b;
-        state->w = cJSON_IsNumber(w) ? w->valueint : state->w;
+    cJSON *gpio = cJSON_GetObjectItemCaseSensitive(root, "gpio");
+    cJSON *count = cJSON_GetObjectItemCaseSensitive(root, "count");
+    cJSON *chip = cJSON_GetObjectItemCaseSensitive(root, "chip");
+    cJSON *order = cJSON_GetObjectItemCaseSensitive(root, "order");
+    cJSON *segments_json = cJSON_GetObjectItemCaseSensitive(root, "segments");
+
+    bool valid = true;
+    if (cJSON_IsNumber(gpio)) {
+        valid &= gpio->valueint >= 0 && gpio->valueint <= UINT8_MAX;
+        config.gpio = (uint8_t)gpio->valueint;
+    }
+    if (cJSON_IsNumber(count)) {
+        valid &= count->valueint > 0 && count->valueint <= CONFIG_LED_MAX_COUNT;
+        config.led_count = (uint16_t)count->valueint;
+    }
+    if (cJSON_IsString(chip) && (chip->valuestring != NULL)) {
+        int index = find_name(led_chip_names, LED_CHIP_MAX, chip->valuestring);
+        valid &= index >= 0;
+        config.chip = (uint8_t)index;
+    }
+    if (cJSON_IsString(order) && (order->valuestring != NULL)) {
+        int index = find_name(led_order_names, LED_ORDER_MAX, order->valuestring);
+        valid &= index >= 0;
+        config.color_order = (uint8_t)index;
     }
 
-    // Brightness parsing
-    cJSON *brightness_json = cJSON_GetObjectItemCaseSensitive(root, "brightness");
-    state->brightness = cJSON_IsNumber(brightness_json) ? 
-                        brightness_json->valueint : state->brightness;
+    led_segment_layout_t segments;
+    memset(&segments, 0, sizeof(segments));
+    if (cJSON_IsArray(segments_json)) {
+        cJSON *segment_json = NULL;
+        cJSON_ArrayForEach(segment_json, segments_json) {
+            if (segments.count == CONFIG_LED_MAX_SEGMENTS) {
+                valid = false;
+                break;
+            }
+            led_segment_t *segment = &segments.segments[segments.count++];
+            cJSON *name = cJSON_GetObjectItemCaseSensitive(segment_json, "name");
+            cJSON *start = cJSON_GetObjectItemCaseSensitive(segment_json, "start");
+            cJSON *seg_count = cJSON_GetObjectItemCaseSensitive(segment_json, "count");
 
+            valid &= cJSON_IsNumber(start) && start->valueint >= 0 && start->valueint <= UINT16_MAX;
+            valid &= cJSON_IsNumber(seg_count) && seg_count->valueint > 0 && seg_count->valueint <= UINT16_MAX;
+            if (!valid) {
+                break;
+            }
+            segment->start = (uint16_t)start->valueint;
+            segment->count = (uint16_t)seg_count->valueint;
+            if (cJSON_IsString(name) && (name->valuestring != NULL)) {
+                snprintf(segment->name, sizeof(segment->name), "%s", name->valuestring);
+            }
+        }
+    } else {
+        segments.count = 1;
+        segments.segments[0].count = config.led_count;
+    }
     cJSON_Delete(root);
-    return true;
+
+    if (!valid) {
+        ESP_LOGE(TAG_mqtt, "Rejected LED config with out of range values");
+        return;
+    }
+
+    // The message is retained, so it is received again after every reconnect
+    if (memcmp(&config, current, sizeof(led_hw_config_t)) == 0 &&
+        memcmp(&segments, device_config_get_segments(), sizeof(led_segment_layout_t)) == 0) {
+        ESP_LOGI(TAG_mqtt, "LED config unchanged");
+        return;
+    }
+
+    if (device_config_store_led_config(&config, &segments)) {
+        ESP_LOGI(TAG_mqtt, "LED config changed, restarting to apply it");
+        device_config_flush();
+        esp_restart();
+    }
+}
+
+// Build the discovery payloads once per boot, they only change with the firmware or the LED config
+static void build_discovery(void) {
+    discovery_hash = FNV1A_INIT;
+    for (int i = 0; i < entity_count(); i++) {
+        const entity_t *entity = entity_get(i);
+        if (discovery_payloads[i] == NULL) {
+            discovery_payloads[i] = create_config(entity);
+        }
+        if (discovery_payloads[i] == NULL) {
+            ESP_LOGE(TAG_mqtt, "Failed to build discovery payload of %s", entity->unique_id);
+            continue;
+        }
+        discovery_hash = fnv1a(discovery_hash, entity->config_topic, strlen(entity->config_topic) + 1);
+        discovery_hash = fnv1a(discovery_hash, discovery_payloads[i], strlen(discovery_payloads[i]) + 1);
+    }
 }
 
 // Function to publish configuration topics
-static void publish_config(esp_mqtt_client_handle_t client) {
-    char *my_config = create_config();
-    esp_mqtt_client_publish(client, config_topic, my_config, 0, 1, true);
+// The hash is stored once the broker acknowledged every payload
+static void publish_config(esp_mqtt_client_handle_t client, const entity_t *entity) {
+    if (discovery_payloads[entity->index] == NULL) {
+        return;
+    }
+    int msg_id = esp_mqtt_client_publish(client, entity->config_topic, discovery_payloads[entity->index], 0, 1, true);
+    discovery_msg_ids[entity->index] = msg_id;
+    if (msg_id < 0) {
+        ESP_LOGE(TAG_mqtt, "Failed to publish configuration of %s", entity->unique_id);
+    }
+}
+
+// Publish the discovery payload of every entity
+static void publish_discovery(esp_mqtt_client_handle_t client) {
+    for (int i = 0; i < entity_count(); i++) {
+        publish_config(client, entity_get(i));
+    }
     ESP_LOGI(TAG_mqtt, "Published configuration topics");
-    free(my_config);
 }
 
-// Public function to access light state from other modules
-light_state_t* mqtt_get_light_state(void) {
-    return &stLightState;
+// Publish discovery and the current state of every entity again
+static void reannounce(esp_mqtt_client_handle_t client) {
+    ESP_LOGI(TAG_mqtt, "Re-announcing discovery and state");
+    publish_discovery(client);
+    for (int i = 0; i < entity_count(); i++) {
+        publish_state(client, entity_get(i));
+    }
+}
+
+// The handler takes the client from the event, a custom event does not set it
+static void reannounce_timer_callback(TimerHandle_t timer) {
+    esp_mqtt_event_t event = { .client = mqtt_client };
+    esp_mqtt_dispatch_custom_event(mqtt_client, &event);
+}
+
+// Re-announce once this device's offset into the window has passed
+// Another birth message meanwhile restarts the delay instead of adding a publish
+static void schedule_reannounce(esp_mqtt_client_handle_t client) {
+    TickType_t delay = pdMS_TO_TICKS(reannounce_delay_ms);
+    if (reannounce_timer == NULL || delay == 0 ||
+        xTimerChangePeriod(reannounce_timer, delay, 0) != pdPASS) {
+        reannounce(client);
+        return;
+    }
+    ESP_LOGI(TAG_mqtt, "Home Assistant is online, republishing discovery in %" PRIu32 " ms", reannounce_delay_ms);
+}
+
+// Store the discovery hash once the last discovery publish has been acknowledged
+static void handle_published(esp_mqtt_client_handle_t client, int msg_id) {
+    bool pending = false;
+    bool matched = false;
+    for (int i = 0; i < entity_count(); i++) {
+        if (discovery_msg_ids[i] > 0 && discovery_msg_ids[i] == msg_id) {
+            discovery_msg_ids[i] = 0;
+            matched = true;
+        }
+        pending |= discovery_msg_ids[i] != 0;
+    }
+    if (matched && !pending) {
+        device_config_store_discovery_hash(discovery_hash);
+        boot_timing_mark(BOOT_DISCOVERY_PUBLISHED);
+        publish_boot_timing(client);
+    }
+}
+
+// Publish the startup milestones once discovery is done, the last milestone that needs the broker
+static void publish_boot_timing(esp_mqtt_client_handle_t client) {
+    if (boot_timing_published || boot_timing_get_us(BOOT_DISCOVERY_PUBLISHED) == 0) {
+        return;
+    }
+    char payload[BOOT_TIMING_JSON_MAX_LEN];
+    size_t len = boot_timing_write_json(payload, sizeof(payload));
+    if (len == 0) {
+        ESP_LOGE(TAG_mqtt, "Boot timing does not fit the publish buffer");
+        return;
+    }
+    send_state(client, boot_timing_topic, payload, (int)len, false);
+    boot_timing_published = true;
+    ESP_LOGI(TAG_mqtt, "Boot timing: %s", payload);
+}
+
+void mqtt_restore_light_states(void) {
+    int count = device_config_get_segments()->count;
+    for (int i = 0; i < count; i++) {
+        restore_light_state(i);
+    }
+}
+
+uint32_t mqtt_read_light_state(int segment, light_state_t *out) {
+    return light_snapshot_read(&published_states[segment], out, NULL);
+}
+
+uint32_t mqtt_read_light_target(int segment, light_state_t *out, uint32_t *transition_ms) {
+    return light_snapshot_read(&published_states[segment], out, transition_ms);
+}
+
+uint32_t mqtt_get_light_state_version(int segment) {
+    return light_snapshot_version(&published_states[segment]);
+}
+
+// Commands against publishes shows how much the coalescing saves
+static void stats_timer_callback(TimerHandle_t timer) {
+    mqtt_stats_t current;
+    mqtt_get_stats(&current);
+    ESP_LOGI(TAG_mqtt, "%" PRIu32 " commands, %" PRIu32 " coalesced, %" PRIu32 " states published, %" PRIu32 " messages dropped",
+             current.commands, current.coalesced, current.published, current.dropped);
+
+    mqtt_outbox_stats_t outbox;
+    mqtt_outbox_get_stats(&outbox);
+    ESP_LOGI(TAG_mqtt, "Outbox: %" PRIu32 " stored, %" PRIu32 " replaced, %" PRIu32 " evicted, %" PRIu32 " rejected, %" PRIu32 " flushed",
+             outbox.stored, outbox.replaced, outbox.evicted, outbox.rejected, outbox.flushed);
 }
 
 void mqtt_app_start(void)
 {
-    // Set up topics using the device ID
-    setup_topics();
-    
+    // Called again on every Wi-Fi reconnect, the entities, topics and client already exist then
+    if (mqtt_client != NULL) {
+        ESP_LOGI(TAG_mqtt, "Network is back, reconnecting the MQTT client");
+        esp_mqtt_client_reconnect(mqtt_client);
+        return;
+    }
+
+    if (!topics_initialized) {
+        boot_timing_mark(BOOT_MQTT_START);
+
+        // Set up topics using the device ID
+        setup_topics();
+        build_discovery();
+        if (!mqtt_outbox_init()) {
+            ESP_LOGE(TAG_mqtt, "Failed to create the outbox, state changes while offline are lost");
+        }
+
+        // Spread a fleet over the window: the offset depends only on the device ID
+        const char *device_id = device_config_get_id();
+        uint32_t window_ms = CONFIG_MQTT_REANNOUNCE_WINDOW_MS;
+        reannounce_delay_ms = window_ms > 0 ? fnv1a(FNV1A_INIT, device_id, strlen(device_id)) % window_ms : 0;
+        reannounce_timer = xTimerCreate("reannounce", 1, pdFALSE, NULL, reannounce_timer_callback);
+
+        for (int i = 0; i < entity_count(); i++) {
+            publish_timers[i] = xTimerCreate("state_publish", 1, pdFALSE, (void *)(intptr_t)i, publish_timer_callback);
+        }
+        stats_timer = xTimerCreate("mqtt_stats", pdMS_TO_TICKS(STATS_LOG_INTERVAL_MS), pdTRUE, NULL, stats_timer_callback);
+        if (stats_timer != NULL) {
+            xTimerStart(stats_timer, 0);
+        }
+        topics_initialized = true;
+    }
+
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = CONFIG_BROKER_URL,
         .credentials.username = CONFIG_MQTT_USERNAME,
@@ -265,7 +1037,19 @@ void mqtt_app_start(void)
     };
 
     esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
+    if (client == NULL) {
+        ESP_LOGE(TAG_mqtt, "Failed to create the MQTT client");
+        return;
+    }
+    mqtt_client = client;
     /* The last argument may be used to pass data to the event handler, in this example mqtt_event_handler */
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
     esp_mqtt_client_start(client);
+}
+
+void mqtt_get_stats(mqtt_stats_t *out) {
+    out->commands = stats.commands;
+    out->coalesced = stats.coalesced;
+    out->dropped = stats.dropped;
+    out->published = __atomic_load_n(&stats.published, __ATOMIC_RELAXED);
 }
\ No newline at end of file
@@ -5,10 +5,32 @@
 #include "mqtt_client.h"
 #include "lightstate.h"
 
+// Command and state publish counters
+typedef struct {
+    uint32_t commands;      // Entity commands received
+    uint32_t coalesced;     // Commands whose state publish was merged into a later one
+    uint32_t published;     // State messages published
+    uint32_t dropped;       // Messages dropped for exceeding the reassembly buffer or arriving incomplete
+} mqtt_stats_t;
+
+// Load the light states persisted in NVS, so the LED task renders them before the network is up
+// Call once after device_config_init() and before the LED task starts
+void mqtt_restore_light_states(void);
+
 // Public API function to start MQTT client
 void mqtt_app_start(void);
 
-// Function to get current light state (if needed in other modules)
-light_state_t* mqtt_get_light_state(void);
+// Get the command and publish counters
+void mqtt_get_stats(mqtt_stats_t *out);
+
+// Copy the current light state of a segment, safe to call from any task without locking
+// Returns the version of the copied state
+uint32_t mqtt_read_light_state(int segment, light_state_t *out);
+
+// Like mqtt_read_light_state(), also copying the fade requested with the state
+uint32_t mqtt_read_light_target(int segment, light_state_t *out, uint32_t *transition_ms);
+
+// Version of the light state of a segment, changes every time a command sets a new state
+uint32_t mqtt_get_light_state_version(int segment);
 
 #endif // MQTT_APP_H
\ No newline at end of file
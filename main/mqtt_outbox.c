@@ -0,0 +1,172 @@
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#include "mqtt_outbox.h"
+#include "fnv1a.h"
+
+static const char *TAG = "mqtt_outbox";
+
+typedef struct {
+    uint32_t seq;           // Order of the last put, 0 for an empty slot
+    uint32_t topic_hash;    // Checked before the topic is compared
+    int len;
+    uint8_t qos;
+    bool retain;
+    char topic[64];
+    char payload[CONFIG_MQTT_OUTBOX_PAYLOAD_SIZE];
+} outbox_slot_t;
+
+static outbox_slot_t slots[CONFIG_MQTT_OUTBOX_SLOTS];
+static uint32_t next_seq = 1;
+static mqtt_outbox_stats_t stats;
+static SemaphoreHandle_t outbox_lock = NULL;    // Guards the fields above
+
+bool mqtt_outbox_init(void) {
+    if (outbox_lock == NULL) {
+        outbox_lock = xSemaphoreCreateMutex();
+    }
+    return outbox_lock != NULL;
+}
+
+bool mqtt_outbox_put(const char *topic, const char *payload, int len, int qos, bool retain) {
+    if (outbox_lock == NULL) {
+        return false;
+    }
+    size_t topic_len = strlen(topic);
+    if (topic_len >= sizeof(slots[0].topic) || len < 0 || len > (int)sizeof(slots[0].payload)) {
+        xSemaphoreTake(outbox_lock, portMAX_DELAY);
+        stats.rejected++;
+        xSemaphoreGive(outbox_lock);
+        ESP_LOGW(TAG, "Message on %s does not fit the outbox", topic);
+        return false;
+    }
+    uint32_t hash = fnv1a(FNV1A_INIT, topic, topic_len);
+
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    // The slot of the same topic, else an empty one, else the oldest
+    outbox_slot_t *slot = NULL;
+    outbox_slot_t *empty = NULL;
+    outbox_slot_t *oldest = &slots[0];
+    for (int i = 0; i < CONFIG_MQTT_OUTBOX_SLOTS; i++) {
+        outbox_slot_t *candidate = &slots[i];
+        if (candidate->seq == 0) {
+            if (empty == NULL) {
+                empty = candidate;
+            }
+            continue;
+        }
+        if (candidate->topic_hash == hash && strcmp(candidate->topic, topic) == 0) {
+            slot = candidate;
+            break;
+        }
+        if (oldest->seq == 0 || candidate->seq < oldest->seq) {
+            oldest = candidate;
+        }
+    }
+    if (slot != NULL) {
+        stats.replaced++;
+    } else if (empty != NULL) {
+        slot = empty;
+        stats.stored++;
+    } else {
+        ESP_LOGD(TAG, "Outbox full, dropped the message on %s", oldest->topic);
+        slot = oldest;
+        stats.evicted++;
+    }
+
+    slot->seq = next_seq++;
+    slot->topic_hash = hash;
+    slot->len = len;
+    slot->qos = (uint8_t)qos;
+    slot->retain = retain;
+    memcpy(slot->topic, topic, topic_len + 1);
+    memcpy(slot->payload, payload, len);
+    xSemaphoreGive(outbox_lock);
+    return true;
+}
+
+int mqtt_outbox_flush(esp_mqtt_client_handle_t client) {
+    if (outbox_lock == NULL) {
+        return 0;
+    }
+    int published = 0;
+    // Only messages kept before the flush started, a put meanwhile waits for the next one
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    uint32_t flush_seq = next_seq;
+    xSemaphoreGive(outbox_lock);
+
+    while (true) {
+        // Copied out so the publish runs without holding the lock
+        outbox_slot_t message;
+        bool found = false;
+        xSemaphoreTake(outbox_lock, portMAX_DELAY);
+        outbox_slot_t *oldest = NULL;
+        for (int i = 0; i < CONFIG_MQTT_OUTBOX_SLOTS; i++) {
+            if (slots[i].seq != 0 && slots[i].seq < flush_seq &&
+                (oldest == NULL || slots[i].seq < oldest->seq)) {
+                oldest = &slots[i];
+            }
+        }
+        if (oldest != NULL) {
+            message = *oldest;
+            oldest->seq = 0;
+            found = true;
+        }
+        xSemaphoreGive(outbox_lock);
+        if (!found) {
+            break;
+        }
+
+        if (esp_mqtt_client_publish(client, message.topic, message.payload, message.len,
+                                    message.qos, message.retain) < 0) {
+            // Disconnected again, keep it for the next connection unless a newer one arrived
+            ESP_LOGW(TAG, "Flush interrupted after %d messages", published);
+            xSemaphoreTake(outbox_lock, portMAX_DELAY);
+            bool newer = false;
+            for (int i = 0; i < CONFIG_MQTT_OUTBOX_SLOTS; i++) {
+                newer |= slots[i].seq != 0 && slots[i].topic_hash == message.topic_hash &&
+                         strcmp(slots[i].topic, message.topic) == 0;
+            }
+            xSemaphoreGive(outbox_lock);
+            if (!newer) {
+                mqtt_outbox_put(message.topic, message.payload, message.len, message.qos, message.retain);
+            }
+            break;
+        }
+        published++;
+    }
+
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    stats.flushed += published;
+    xSemaphoreGive(outbox_lock);
+    if (published > 0) {
+        ESP_LOGI(TAG, "Published %d messages kept while offline", published);
+    }
+    return published;
+}
+
+bool mqtt_outbox_contains(const char *topic) {
+    if (outbox_lock == NULL) {
+        return false;
+    }
+    uint32_t hash = fnv1a(FNV1A_INIT, topic, strlen(topic));
+    bool found = false;
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    for (int i = 0; i < CONFIG_MQTT_OUTBOX_SLOTS && !found; i++) {
+        found = slots[i].seq != 0 && slots[i].topic_hash == hash && strcmp(slots[i].topic, topic) == 0;
+    }
+    xSemaphoreGive(outbox_lock);
+    return found;
+}
+
+void mqtt_outbox_get_stats(mqtt_outbox_stats_t *out) {
+    if (outbox_lock == NULL) {
+        memset(out, 0, sizeof(mqtt_outbox_stats_t));
+        return;
+    }
+    xSemaphoreTake(outbox_lock, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(outbox_lock);
+}
@@ -0,0 +1,38 @@
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mqtt_client.h"
+
+// Messages published while the broker is unreachable, at most one per topic
+// A fixed number of slots is allocated statically, a long outage cannot grow it
+
+typedef struct {
+    uint32_t stored;        // Messages put in an empty slot
+    uint32_t replaced;      // Messages that replaced an older one with the same topic
+    uint32_t evicted;       // Oldest messages dropped to make room for another topic
+    uint32_t rejected;      // Messages too large for a slot
+    uint32_t flushed;       // Messages published on reconnect
+} mqtt_outbox_stats_t;
+
+// Create the lock guarding the slots
+// Returns true on success
+bool mqtt_outbox_init(void);
+
+// Keep a message for the next connection, replacing a kept message with the same topic
+// Safe to call from any task. When every slot holds another topic the oldest message is dropped
+// Returns false if the topic or payload does not fit a slot
+bool mqtt_outbox_put(const char *topic, const char *payload, int len, int qos, bool retain);
+
+// Returns true if a message for topic is kept
+bool mqtt_outbox_contains(const char *topic);
+
+// Publish the kept messages oldest first and empty the outbox, call from the MQTT task once connected
+// Returns the number of messages published
+int mqtt_outbox_flush(esp_mqtt_client_handle_t client);
+
+// Get the outbox counters
+void mqtt_outbox_get_stats(mqtt_outbox_stats_t *out);
+
+#endif // MQTT_OUTBOX_H
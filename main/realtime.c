@@ -0,0 +1,342 @@
+#include "realtime.h"
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <errno.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "led_control.h"
+#include "led_driver.h"
+
+// DDP header, see http://www.3waylabs.com/ddp/
+#define DDP_HEADER_LEN 10
+#define DDP_TIMECODE_LEN 4
+#define DDP_FLAGS_VER_MASK 0xC0
+#define DDP_FLAGS_VER1 0x40
+#define DDP_FLAGS_TIMECODE 0x10
+#define DDP_FLAGS_PUSH 0x01
+#define DDP_TYPE_RGB8 0x0B
+#define DDP_TYPE_RGBW8 0x1B
+#define DDP_ID_DISPLAY 1
+
+// E1.31 (sACN) data packet layout, ANSI E1.31-2018
+#define E131_ROOT_VECTOR_OFFSET 18
+#define E131_ROOT_VECTOR_DATA 0x00000004
+#define E131_FRAMING_VECTOR_OFFSET 40
+#define E131_FRAMING_VECTOR_DATA 0x00000002
+#define E131_SEQUENCE_OFFSET 111
+#define E131_OPTIONS_OFFSET 112
+#define E131_UNIVERSE_OFFSET 113
+#define E131_PROPERTY_COUNT_OFFSET 123
+#define E131_START_CODE_OFFSET 125
+#define E131_DATA_OFFSET 126
+#define E131_OPTION_PREVIEW 0x80
+#define E131_OPTION_TERMINATED 0x40
+#define E131_PIXELS_PER_UNIVERSE 170
+#define E131_UNIVERSE_COUNT ((CONFIG_LED_MAX_COUNT + E131_PIXELS_PER_UNIVERSE - 1) / E131_PIXELS_PER_UNIVERSE)
+
+// Largest packet accepted, a full Ethernet MTU of DDP pixel data
+#define RX_BUFFER_LEN 1500
+
+// Delay before a socket that could not be opened is tried again
+#define SOCKET_RETRY_MS 5000
+
+static const char *TAG = "realtime";
+static const uint8_t e131_packet_id[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+
+static uint8_t rx_buffer[RX_BUFFER_LEN];
+static realtime_stats_t stats;
+static volatile bool active = false;
+static uint32_t last_packet_ms = 0;
+static uint8_t ddp_last_sequence = 0;
+static uint8_t e131_last_sequence[E131_UNIVERSE_COUNT];
+
+static inline uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static inline uint16_t read_be16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t read_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static int open_udp_socket(uint16_t port)
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket for port %d", port);
+        return -1;
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        ESP_LOGE(TAG, "Unable to bind port %d", port);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Write RGB or RGBW bytes from the receive buffer straight into the locked frame
+// offset is the byte offset of data[0] in the stream, which may split a pixel
+// An RGB stream turns the white channel of an RGBW strip off, an RGBW stream
+// on an RGB strip drops the white byte
+static void write_pixels(uint8_t *frame, uint32_t offset, const uint8_t *data, uint32_t len, uint32_t channels)
+{
+    const led_pixel_layout_t *layout = led_driver_layout();
+    bool has_white = led_driver_has_white(layout);
+    const uint8_t channel_offsets[4] = { layout->r, layout->g, layout->b, layout->w };
+    uint32_t pixel = offset / channels;
+    uint32_t channel = offset % channels;
+    uint32_t led_count = (uint32_t)led_control_get_led_count();
+
+    uint8_t *out = frame + pixel * layout->bytes_per_pixel;
+    for (uint32_t i = 0; i < len && pixel < led_count; i++) {
+        if (channel < 3 || has_white) {
+            out[channel_offsets[channel]] = data[i];
+        }
+        if (++channel == channels) {
+            if (channels == 3 && has_white) {
+                out[layout->w] = 0;
+            }
+            channel = 0;
+            pixel++;
+            out += layout->bytes_per_pixel;
+        }
+    }
+}
+
+// Lock the frame for one packet, entering realtime mode on the first one
+// Returns the frame to write into, or NULL if the strip is not ready
+static uint8_t* begin_packet(void)
+{
+    uint8_t *frame = led_control_realtime_begin();
+    if (frame != NULL && !active) {
+        active = true;
+        stats.streams++;
+        ESP_LOGI(TAG, "Realtime stream started");
+    }
+    return frame;
+}
+
+static void end_stream(const char *reason)
+{
+    if (active) {
+        active = false;
+        led_control_realtime_stop();
+        ESP_LOGI(TAG, "Realtime stream stopped (%s)", reason);
+    }
+}
+
+static void handle_ddp(const uint8_t *packet, int len)
+{
+    if (len < DDP_HEADER_LEN || (packet[0] & DDP_FLAGS_VER_MASK) != DDP_FLAGS_VER1) {
+        stats.dropped++;
+        return;
+    }
+
+    uint8_t flags = packet[0];
+    uint8_t sequence = packet[1] & 0x0F;
+    uint8_t type = packet[2];
+    uint8_t id = packet[3];
+    uint32_t offset = read_be32(&packet[4]);
+    uint32_t data_len = read_be16(&packet[8]);
+    int header_len = DDP_HEADER_LEN + ((flags & DDP_FLAGS_TIMECODE) ? DDP_TIMECODE_LEN : 0);
+
+    if (id != DDP_ID_DISPLAY || (type != 0 && type != DDP_TYPE_RGB8 && type != DDP_TYPE_RGBW8) ||
+        header_len + (int)data_len > len) {
+        stats.dropped++;
+        return;
+    }
+
+    // Sequence numbers run 1-15, 0 means the sender does not use them
+    if (active && sequence != 0 && ddp_last_sequence != 0) {
+        uint8_t ahead = (sequence - ddp_last_sequence) & 0x0F;
+        if (ahead == 0 || ahead > 8) {
+            stats.late++;
+            return;
+        }
+    }
+    ddp_last_sequence = sequence;
+
+    uint8_t *frame = begin_packet();
+    if (frame == NULL) {
+        stats.dropped++;
+        return;
+    }
+    write_pixels(frame, offset, packet + header_len, data_len, type == DDP_TYPE_RGBW8 ? 4 : 3);
+    stats.packets++;
+
+    bool push = (flags & DDP_FLAGS_PUSH) != 0;
+    led_control_realtime_end(push);
+    if (push) {
+        stats.frames++;
+    }
+}
+
+static void handle_e131(const uint8_t *packet, int len)
+{
+    if (len < E131_DATA_OFFSET || memcmp(&packet[4], e131_packet_id, sizeof(e131_packet_id)) != 0 ||
+        read_be32(&packet[E131_ROOT_VECTOR_OFFSET]) != E131_ROOT_VECTOR_DATA ||
+        read_be32(&packet[E131_FRAMING_VECTOR_OFFSET]) != E131_FRAMING_VECTOR_DATA ||
+        packet[E131_START_CODE_OFFSET] != 0) {
+        stats.dropped++;
+        return;
+    }
+
+    uint8_t options = packet[E131_OPTIONS_OFFSET];
+    if (options & E131_OPTION_TERMINATED) {
+        end_stream("terminated by source");
+        return;
+    }
+    if (options & E131_OPTION_PREVIEW) {
+        stats.dropped++;
+        return;
+    }
+
+    // Every universe carries 170 RGB pixels, starting at the configured universe
+    uint16_t universe = read_be16(&packet[E131_UNIVERSE_OFFSET]);
+    int index = (int)universe - CONFIG_REALTIME_E131_UNIVERSE;
+    int led_count = led_control_get_led_count();
+    int universe_count = (led_count + E131_PIXELS_PER_UNIVERSE - 1) / E131_PIXELS_PER_UNIVERSE;
+    if (index < 0 || index >= universe_count) {
+        stats.dropped++;
+        return;
+    }
+
+    // The property count includes the start code
+    int data_len = (int)read_be16(&packet[E131_PROPERTY_COUNT_OFFSET]) - 1;
+    if (data_len < 0 || E131_DATA_OFFSET + data_len > len) {
+        stats.dropped++;
+        return;
+    }
+
+    // Discard packets up to 20 sequence numbers behind the last one, as the standard asks
+    int8_t ahead = (int8_t)(packet[E131_SEQUENCE_OFFSET] - e131_last_sequence[index]);
+    if (active && ahead <= 0 && ahead > -20) {
+        stats.late++;
+        return;
+    }
+    e131_last_sequence[index] = packet[E131_SEQUENCE_OFFSET];
+
+    uint8_t *frame = begin_packet();
+    if (frame == NULL) {
+        stats.dropped++;
+        return;
+    }
+    write_pixels(frame, (uint32_t)index * E131_PIXELS_PER_UNIVERSE * 3, &packet[E131_DATA_OFFSET], (uint32_t)data_len, 3);
+    stats.packets++;
+
+    // The last universe of the strip completes the frame
+    bool push = index == universe_count - 1;
+    led_control_realtime_end(push);
+    if (push) {
+        stats.frames++;
+    }
+}
+
+static void realtime_task(void *pvParameters)
+{
+    int ddp_sock = -1;
+    int e131_sock = -1;
+    uint32_t last_open_ms = 0;
+    bool first_open = true;
+
+    while (1) {
+        // A port that could not be opened, e.g. before the network was up, is tried again
+        if ((ddp_sock < 0 || e131_sock < 0) && (first_open || now_ms() - last_open_ms >= SOCKET_RETRY_MS)) {
+            first_open = false;
+            last_open_ms = now_ms();
+            if (ddp_sock < 0 && (ddp_sock = open_udp_socket(CONFIG_REALTIME_DDP_PORT)) >= 0) {
+                ESP_LOGI(TAG, "Listening for DDP on port %d", CONFIG_REALTIME_DDP_PORT);
+            }
+            if (e131_sock < 0 && (e131_sock = open_udp_socket(CONFIG_REALTIME_E131_PORT)) >= 0) {
+                ESP_LOGI(TAG, "Listening for E1.31 on port %d", CONFIG_REALTIME_E131_PORT);
+            }
+        }
+        if (ddp_sock < 0 && e131_sock < 0) {
+            vTaskDelay(pdMS_TO_TICKS(SOCKET_RETRY_MS));
+            continue;
+        }
+
+        fd_set fds;
+        FD_ZERO(&fds);
+        int max_fd = -1;
+        if (ddp_sock >= 0) {
+            FD_SET(ddp_sock, &fds);
+            max_fd = ddp_sock;
+        }
+        if (e131_sock >= 0) {
+            FD_SET(e131_sock, &fds);
+            max_fd = e131_sock > max_fd ? e131_sock : max_fd;
+        }
+
+        // Wake up in time to hand the strip back when the stream goes quiet
+        struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+        if (active) {
+            uint32_t idle = now_ms() - last_packet_ms;
+            uint32_t remaining = idle < CONFIG_REALTIME_TIMEOUT_MS ? CONFIG_REALTIME_TIMEOUT_MS - idle : 0;
+            timeout.tv_sec = remaining / 1000;
+            timeout.tv_usec = (remaining % 1000) * 1000;
+        }
+
+        int ready = select(max_fd + 1, &fds, NULL, NULL, &timeout);
+        if (ready < 0 && errno == EINTR) {
+            // The linux target's FreeRTOS port interrupts system calls with its tick signal
+            continue;
+        }
+        if (ready < 0) {
+            ESP_LOGE(TAG, "select() failed");
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        if (ddp_sock >= 0 && FD_ISSET(ddp_sock, &fds)) {
+            int len = recv(ddp_sock, rx_buffer, sizeof(rx_buffer), 0);
+            if (len > 0) {
+                last_packet_ms = now_ms();
+                handle_ddp(rx_buffer, len);
+            }
+        }
+        if (e131_sock >= 0 && FD_ISSET(e131_sock, &fds)) {
+            int len = recv(e131_sock, rx_buffer, sizeof(rx_buffer), 0);
+            if (len > 0) {
+                last_packet_ms = now_ms();
+                handle_e131(rx_buffer, len);
+            }
+        }
+
+        if (active && now_ms() - last_packet_ms >= CONFIG_REALTIME_TIMEOUT_MS) {
+            end_stream("timeout");
+            ESP_LOGI(TAG, "%" PRIu32 " packets, %" PRIu32 " frames, %" PRIu32 " dropped, %" PRIu32 " late",
+                     stats.packets, stats.frames, stats.dropped, stats.late);
+        }
+    }
+}
+
+void realtime_start(void) {
+    xTaskCreate(&realtime_task, "realtime", 4096, NULL, 5, NULL);
+}
+
+bool realtime_is_active(void) {
+    return active;
+}
+
+void realtime_get_stats(realtime_stats_t *out) {
+    *out = stats;
+}
@@ -0,0 +1,31 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Counters of the realtime receiver
+typedef struct {
+    uint32_t packets;  // Valid packets written to the strip
+    uint32_t frames;   // Frames sent to the strip
+    uint32_t dropped;  // Packets ignored because they were malformed or not for this strip
+    uint32_t late;     // Packets that arrived after a newer one and were discarded
+    uint32_t streams;  // Number of times realtime mode was entered
+} realtime_stats_t;
+
+// Start the UDP listener for DDP and E1.31 (sACN) pixel streams
+// While a stream is active it takes over the strip from the light state,
+// which is shown again CONFIG_REALTIME_TIMEOUT_MS after the last packet
+void realtime_start(void);
+
+// Returns true while a stream owns the strip
+bool realtime_is_active(void);
+
+// Get a copy of the receiver counters
+void realtime_get_stats(realtime_stats_t *stats);
+
+// Linux target: feed the received streams to the simulated strip and log the
+// counters, never returns. tools/realtime_send.py sends test streams
+void realtime_sim_run(void);
+
+#endif // REALTIME_H
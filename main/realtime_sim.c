@@ -0,0 +1,85 @@
+#include "realtime.h"
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "led_control.h"
+#include "led_driver.h"
+#include "led_sim.h"
+
+// Realtime receiver on the linux target
+// Stands in for the realtime hooks of led_control.c, the stream goes straight to the simulated strip
+
+// How often the receiver counters are logged
+#define STATS_LOG_INTERVAL_MS 5000
+
+static const char *TAG = "realtime_sim";
+
+static SemaphoreHandle_t frame_lock = NULL;
+static int led_count = 0;
+
+int led_control_get_led_count(void) {
+    return led_count;
+}
+
+uint8_t* led_control_realtime_begin(void) {
+    if (frame_lock == NULL) {
+        return NULL;
+    }
+
+    xSemaphoreTake(frame_lock, portMAX_DELAY);
+    uint8_t *frame = led_driver_back_buffer();
+    if (frame == NULL) {
+        xSemaphoreGive(frame_lock);
+    }
+    return frame;
+}
+
+void led_control_realtime_end(bool present) {
+    if (present) {
+        led_driver_present();
+    }
+    xSemaphoreGive(frame_lock);
+}
+
+void led_control_realtime_stop(void) {
+    // Nothing to hand the strip back to, the last streamed frame stays recorded
+}
+
+void realtime_sim_run(void) {
+    led_hw_config_t config = {
+        .gpio = CONFIG_LED_GPIO,
+#if CONFIG_LED_SIM_REALTIME_RGBW
+        .chip = LED_CHIP_SK6812_RGBW,
+#else
+        .chip = LED_CHIP_WS2812B,
+#endif
+        .color_order = LED_ORDER_GRB,
+        .led_count = CONFIG_LED_COUNT,
+    };
+    frame_lock = xSemaphoreCreateMutex();
+    if (frame_lock == NULL || !led_driver_init(&config)) {
+        ESP_LOGE(TAG, "Failed to initialise a strip of %d LEDs", CONFIG_LED_COUNT);
+        return;
+    }
+    led_count = config.led_count;
+    realtime_start();
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(STATS_LOG_INTERVAL_MS));
+
+        realtime_stats_t stats;
+        realtime_get_stats(&stats);
+        ESP_LOGI(TAG, "%s: %" PRIu32 " packets, %" PRIu32 " frames, %" PRIu32 " dropped, %" PRIu32 " late, %" PRIu32 " streams",
+                 realtime_is_active() ? "streaming" : "idle",
+                 stats.packets, stats.frames, stats.dropped, stats.late, stats.streams);
+
+        led_sim_frame_t frame;
+        if (led_sim_get_frame(0, &frame)) {
+            ESP_LOGI(TAG, "Frame %" PRIu32 " presented at %lld us, first pixel %02x %02x %02x",
+                     frame.sequence, (long long)frame.timestamp_us, frame.data[0], frame.data[1], frame.data[2]);
+        }
+    }
+}
@@ -0,0 +1,133 @@
+#!/usr/bin/env python
+#
+# Sends a test pixel stream to the realtime receiver over UDP.
+#
+# Streams a moving rainbow as DDP or E1.31 (sACN) packets, to a device or to
+# the linux target build with LED_SIM_REALTIME enabled. DDP frames are split
+# into packets of at most --ddp-chunk bytes, the last one has the push flag.
+# E1.31 sends one universe of 170 RGB pixels per packet, starting at
+# --universe. --reorder sends every other pair of frames in swapped order to
+# exercise the late packet counter, --terminate ends an E1.31 stream explicitly.
+
+import argparse
+import colorsys
+import socket
+import struct
+import time
+import uuid
+
+DDP_PORT = 4048
+E131_PORT = 5568
+
+DDP_FLAGS_VER1 = 0x40
+DDP_FLAGS_PUSH = 0x01
+DDP_TYPE_RGB8 = 0x0B
+DDP_TYPE_RGBW8 = 0x1B
+DDP_ID_DISPLAY = 1
+
+E131_PIXELS_PER_UNIVERSE = 170
+E131_OPTION_TERMINATED = 0x40
+
+
+def rainbow(led_count, frame, channels):
+    data = bytearray()
+    for i in range(led_count):
+        r, g, b = colorsys.hsv_to_rgb(((i + frame) % led_count) / led_count, 1.0, 1.0)
+        pixel = [int(r * 255), int(g * 255), int(b * 255)]
+        if channels == 4:
+            pixel.append(0)
+        data += bytes(pixel)
+    return bytes(data)
+
+
+# Every DDP packet takes the next sequence number, they run 1-15
+def ddp_packets(pixels, sequence, channels, chunk):
+    packets = []
+    data_type = DDP_TYPE_RGBW8 if channels == 4 else DDP_TYPE_RGB8
+    for offset in range(0, len(pixels), chunk):
+        data = pixels[offset:offset + chunk]
+        flags = DDP_FLAGS_VER1
+        if offset + chunk >= len(pixels):
+            flags |= DDP_FLAGS_PUSH
+        header = struct.pack('>BBBBIH', flags, sequence, data_type, DDP_ID_DISPLAY, offset, len(data))
+        packets.append(header + data)
+        sequence = sequence % 15 + 1
+    return packets, sequence
+
+
+def e131_packet(cid, universe, sequence, data, options=0):
+    # Layout of ANSI E1.31-2018 data packets, see E131_* in main/realtime.c
+    dmp = struct.pack('>HBBHHH', 0x7000 | (10 + len(data) + 1), 0x02, 0xA1, 0x0000, 0x0001, len(data) + 1) \
+        + b'\x00' + data
+    framing = struct.pack('>HI', 0x7000 | (77 + len(dmp)), 0x00000002) \
+        + b'realtime_send.py'.ljust(64, b'\x00') \
+        + struct.pack('>BHBBH', 100, 0, sequence, options, universe) + dmp
+    root = struct.pack('>HH', 0x0010, 0x0000) + b'ASC-E1.17\x00\x00\x00' \
+        + struct.pack('>HI', 0x7000 | (22 + len(framing)), 0x00000004) + cid + framing
+    return root
+
+
+def e131_packets(pixels, cid, first_universe, sequence):
+    packets = []
+    universe_len = E131_PIXELS_PER_UNIVERSE * 3
+    for index, offset in enumerate(range(0, len(pixels), universe_len)):
+        packets.append(e131_packet(cid, first_universe + index, sequence, pixels[offset:offset + universe_len]))
+    return packets
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Send a test stream to the DDP / E1.31 receiver')
+    parser.add_argument('--host', default='127.0.0.1', help='receiver address')
+    parser.add_argument('--protocol', choices=['ddp', 'e131'], default='ddp')
+    parser.add_argument('--port', type=int, help='UDP port, the protocol default if not set')
+    parser.add_argument('--leds', type=int, default=30, help='number of LEDs on the strip')
+    parser.add_argument('--fps', type=float, default=30.0, help='frames per second')
+    parser.add_argument('--frames', type=int, default=300, help='number of frames to send')
+    parser.add_argument('--rgbw', action='store_true', help='send 4 channels per pixel (DDP only)')
+    parser.add_argument('--ddp-chunk', type=int, default=1440, help='largest DDP payload per packet')
+    parser.add_argument('--universe', type=int, default=1, help='first E1.31 universe')
+    parser.add_argument('--reorder', action='store_true', help='swap packets to provoke late ones')
+    parser.add_argument('--terminate', action='store_true', help='end an E1.31 stream with the terminated option')
+    args = parser.parse_args()
+
+    if args.rgbw and args.protocol != 'ddp':
+        parser.error('--rgbw needs --protocol ddp')
+    channels = 4 if args.rgbw else 3
+    chunk = args.ddp_chunk - args.ddp_chunk % channels
+    port = args.port or (DDP_PORT if args.protocol == 'ddp' else E131_PORT)
+    cid = uuid.uuid4().bytes
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    period = 1.0 / args.fps
+    next_frame = time.monotonic()
+    ddp_sequence = 1
+    held = []
+    sent = 0
+    for frame in range(args.frames):
+        pixels = rainbow(args.leds, frame, channels)
+        if args.protocol == 'ddp':
+            packets, ddp_sequence = ddp_packets(pixels, ddp_sequence, channels, chunk)
+        else:
+            packets = e131_packets(pixels, cid, args.universe, frame % 256)
+        if args.reorder and frame % 4 == 0 and frame + 1 < args.frames:
+            # Sent after the next frame, which makes them late
+            held = packets
+        else:
+            for packet in packets + held:
+                sock.sendto(packet, (args.host, port))
+                sent += 1
+            held = []
+
+        next_frame += period
+        delay = next_frame - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+
+    if args.terminate and args.protocol == 'e131':
+        sock.sendto(e131_packet(cid, args.universe, args.frames % 256, b'', E131_OPTION_TERMINATED), (args.host, port))
+        sent += 1
+    print('Sent {} frames in {} packets to {}:{}'.format(args.frames, sent, args.host, port))
+
+
+if __name__ == '__main__':
+    main()